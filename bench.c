@@ -0,0 +1,513 @@
+#define _GNU_SOURCE /* posix_openpt, ptsname and cfmakeraw */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "font.h"
+#include "layout.h"
+#include "generator.h"
+#include "pool.h"
+#include "timer.h"
+#include "rs232.h"
+#include "serial.h"
+#include "log.h"
+
+#define BENCH_SIZES "1K,10K,100K,1M,10M,100M" // Synthetic document sizes for the generation benchmark
+#define BENCH_MAX_SIZES 16
+#define BENCH_FONT_ROUNDS 20         // Font parses timed
+#define BENCH_LOOKUPS 2000000        // Glyph lookups timed
+#define BENCH_FORMATS 2000000        // Moves formatted
+#define BENCH_RS232_COMMANDS 5000    // Commands sent through the loopback with the raw rs232 calls
+#define BENCH_SERIAL_COMMANDS 5000   // Commands sent through PrintBuffer and WaitForReply
+#define BENCH_BATCH_LINES 4096       // Same batching as the sender
+#define BENCH_STATUS "<Idle|MPos:0.000,0.000,0.000|Bf:15,128>\r\n" // Loopback answer to '?'
+
+// Measures the pieces of a job one at a time and prints one JSON object per result,
+// so runs can be appended to a file and compared over time.
+
+static const char *font_file; // --font, the built-in font is used otherwise
+static long long sizes[BENCH_MAX_SIZES];
+static int size_count;
+static int thread_count; // 0 uses every core
+static int rs232_commands = BENCH_RS232_COMMANDS;
+static int serial_commands = BENCH_SERIAL_COMMANDS;
+static int skip_loopback;
+
+// Sizes like 64K or 10M, 0 on a malformed entry
+static int ParseSizes(const char *list)
+{
+    const char *p = list;
+
+    size_count = 0;
+    while (*p && size_count < BENCH_MAX_SIZES)
+    {
+        char *end;
+        long long size = strtoll(p, &end, 10);
+
+        switch (toupper((unsigned char)*end))
+        {
+        case 'K':
+            size <<= 10;
+            end++;
+            break;
+        case 'M':
+            size <<= 20;
+            end++;
+            break;
+        case 'G':
+            size <<= 30;
+            end++;
+            break;
+        }
+        if (size <= 0 || (*end && *end != ','))
+            return 0;
+        sizes[size_count++] = size;
+        p = *end ? end + 1 : end;
+    }
+    return size_count;
+}
+
+// The built-in font costs nothing to load, only a font file given with --font is parsed
+static const Font *BenchFontParse(void)
+{
+    static DataEntry fontData[LINE_COUNT];
+    static Font font;
+    long long started = TimerMicros();
+    int i;
+
+    if (!font_file)
+        return &embedded_font;
+
+    for (i = 0; i < BENCH_FONT_ROUNDS; i++)
+    {
+        if (load_font(font_file, fontData))
+            exit(1);
+        index_font(&font, fontData);
+    }
+
+    double seconds = (TimerMicros() - started) / 1e6;
+    printf("{\"bench\":\"font_parse\",\"rounds\":%d,\"seconds\":%.6f,\"us_per_parse\":%.1f}\n", BENCH_FONT_ROUNDS,
+           seconds, seconds * 1e6 / BENCH_FONT_ROUNDS);
+    return &font;
+}
+
+static void BenchGlyphLookup(const Font *font)
+{
+    static const char characters[] = "The quick brown fox jumps over the lazy dog 0123456789.,;:!?";
+    long long started = TimerMicros();
+    long strokes = 0;
+    int i, count;
+
+    for (i = 0; i < BENCH_LOOKUPS; i++)
+    {
+        if (find_character_data(characters[i % (sizeof(characters) - 1)], font, &count))
+            strokes += count;
+    }
+
+    double seconds = (TimerMicros() - started) / 1e6;
+    printf("{\"bench\":\"glyph_lookup\",\"font\":\"%s\",\"lookups\":%d,\"seconds\":%.6f,\"lookups_per_sec\":%.0f,"
+           "\"strokes\":%ld}\n",
+           font == &embedded_font ? "embedded" : "file", BENCH_LOOKUPS, seconds, BENCH_LOOKUPS / seconds, strokes);
+}
+
+static void BenchFormat(void)
+{
+    MotionState motion;
+    char buffer[256];
+    size_t bytes = 0;
+    long long started = TimerMicros();
+    int i;
+
+    feed_planner_init(&motion.feed);
+    motion.pen_down = 0;
+    motion.profile = NULL;
+
+    for (i = 0; i < BENCH_FORMATS; i++)
+    {
+        float x = (i % 997) * 0.173F, y = (i % 89) * -0.291F;
+        float next[2] = {x + 0.5F, y - 0.25F};
+
+        if (i % 16 == 0)
+            bytes += format_pen(&motion, buffer, !motion.pen_down);
+        format_move(&motion.feed, buffer, motion.pen_down, x, y, next);
+        bytes += strlen(buffer);
+    }
+
+    double seconds = (TimerMicros() - started) / 1e6;
+    printf("{\"bench\":\"format\",\"commands\":%d,\"seconds\":%.6f,\"ns_per_command\":%.1f,\"bytes\":%zu}\n",
+           BENCH_FORMATS, seconds, seconds * 1e9 / BENCH_FORMATS, bytes);
+}
+
+// Deterministic text of the given size, words of mixed length separated by spaces and newlines
+static char *SyntheticText(long long size)
+{
+    static const char *words[] = {"the", "writing", "robot", "draws", "each", "glyph", "with", "a", "single",
+                                  "stroke,", "pen", "lifts", "between", "letters.", "G-code", "3.14", "12:45",
+                                  "(draft)", "Quick!", "zero-copy"};
+    char *text = malloc(size + 1);
+    unsigned seed = 12345;
+    long long length = 0;
+
+    if (!text)
+    {
+        printf("Out of memory for a %lld byte document\n", size);
+        exit(1);
+    }
+
+    while (length < size)
+    {
+        seed = seed * 1103515245 + 12345;
+        const char *word = words[(seed >> 16) % (sizeof(words) / sizeof(words[0]))];
+        size_t word_length = strlen(word);
+
+        if (length + (long long)word_length + 1 > size)
+            word_length = (size_t)(size - length - 1 > 0 ? size - length - 1 : 0);
+        memcpy(text + length, word, word_length);
+        length += word_length;
+        if (length < size)
+            text[length++] = (seed >> 8) % 12 ? ' ' : '\n';
+    }
+    text[size] = 0;
+    return text;
+}
+
+// Layout and generation of one document, the way the sender batches them, with the output discarded
+static void BenchGenerate(const Font *font, long long size, ThreadPool *pool, int threads)
+{
+    static CommandBlock blocks[BENCH_BATCH_LINES + 1];
+    char *text = SyntheticText(size);
+    char *word = text;
+    Document document;
+    size_t output = 0;
+    long lines = 0;
+    int i;
+
+    for (i = 0; i <= BENCH_BATCH_LINES; i++)
+        block_init(&blocks[i]);
+
+    long long started = TimerMicros();
+    document_init(&document, 5 / CHAR_WIDTH);
+
+    while (1)
+    {
+        while (*word && isspace((unsigned char)*word))
+            word++;
+        if (!*word)
+            break;
+
+        char *end = word;
+        while (*end && !isspace((unsigned char)*end))
+            end++;
+        char saved = *end;
+        *end = 0;
+        layout_word(&document, word);
+        *end = saved;
+        word = end;
+
+        if (document.line_count > BENCH_BATCH_LINES)
+        {
+            generate_lines(&document, document.line_count - 1, font, blocks, pool);
+            for (i = 0; i < document.line_count - 1; i++)
+                output += blocks[i].length;
+            lines += document.line_count - 1;
+            document_keep_open_line(&document);
+        }
+    }
+    generate_lines(&document, document.line_count, font, blocks, pool);
+    for (i = 0; i < document.line_count; i++)
+        output += blocks[i].length;
+    lines += document.line_count;
+
+    double seconds = (TimerMicros() - started) / 1e6;
+    printf("{\"bench\":\"generate\",\"input_bytes\":%lld,\"output_bytes\":%zu,\"lines\":%ld,\"threads\":%d,"
+           "\"seconds\":%.6f,\"input_bytes_per_sec\":%.0f,\"output_bytes_per_sec\":%.0f}\n",
+           size, output, lines, threads, seconds, size / seconds, output / seconds);
+    fflush(stdout);
+
+    document_free(&document);
+    for (i = 0; i <= BENCH_BATCH_LINES; i++)
+        block_free(&blocks[i]);
+    free(text);
+}
+
+static void ReportLoopback(const char *path, int commands, long long started)
+{
+    double seconds = (TimerMicros() - started) / 1e6;
+    printf("{\"bench\":\"loopback\",\"path\":\"%s\",\"commands\":%d,\"seconds\":%.6f,\"commands_per_sec\":%.1f,"
+           "\"us_per_command\":%.1f}\n",
+           path, commands, seconds, commands / seconds, seconds * 1e6 / commands);
+    fflush(stdout);
+}
+
+#if defined(__linux__) || defined(__FreeBSD__)
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+#include <termios.h>
+#include <unistd.h>
+
+static int master = -1; // Controller end of the loopback: the pty master or the accepted socket
+static atomic_int echo_running;
+
+// Controller side of the loopback: one "ok" per complete line, as fast as the pty allows
+static void *EchoController(void *unused)
+{
+    unsigned char buf[4096];
+    struct pollfd pfd;
+    int i, n;
+
+    (void)unused;
+    pfd.fd = master;
+    pfd.events = POLLIN;
+
+    while (atomic_load(&echo_running))
+    {
+        pfd.revents = 0;
+        if (poll(&pfd, 1, 50) <= 0 || !(pfd.revents & POLLIN))
+            continue;
+        n = (int)read(master, buf, sizeof(buf));
+        for (i = 0; i < n; i++)
+        {
+            if (buf[i] == '\n' && write(master, "ok\r\n", 4) != 4)
+                return NULL;
+            if (buf[i] == '?' && write(master, BENCH_STATUS, sizeof(BENCH_STATUS) - 1) != sizeof(BENCH_STATUS) - 1)
+                return NULL; // The rate probe asks for status when the port opens
+        }
+    }
+    return NULL;
+}
+
+// Pseudo terminal pair, the device name of the far end goes to device
+static int OpenLoopback(char *device, size_t size)
+{
+    struct termios settings;
+    int slave;
+
+    master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master == -1 || grantpt(master) || unlockpt(master))
+    {
+        perror("unable to create pseudo terminal");
+        return (-1);
+    }
+
+    slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+    if (slave == -1 || tcgetattr(slave, &settings))
+    {
+        perror("unable to open pseudo terminal");
+        return (-1);
+    }
+    cfmakeraw(&settings);
+    tcsetattr(slave, TCSANOW, &settings);
+    close(slave);
+
+    snprintf(device, size, "%s", ptsname(master));
+    return (0);
+}
+
+// Send and wait for each ok, once with the bare rs232 calls and once through serial.c as the sender does
+static void BenchLoopback(void)
+{
+    static const char command[] = "G1 X12.345 Y-67.890 F1000\n";
+    unsigned char buf[256];
+    char device[RS232_NAME_SIZE];
+    RS232_Port *port = NULL;
+    pthread_t echo;
+    int i, n;
+
+    if (OpenLoopback(device, sizeof(device)) || !(port = RS232_Open(device, bdrate, "8N1", 0)))
+    {
+        printf("{\"bench\":\"loopback\",\"skipped\":\"unable to open the pseudo terminal\"}\n");
+        return;
+    }
+    atomic_store(&echo_running, 1);
+    pthread_create(&echo, NULL, EchoController, NULL);
+
+    long long started = TimerMicros();
+    for (i = 0; i < rs232_commands; i++)
+    {
+        int seen = 0;
+
+        RS232_Write(port, (const unsigned char *)command, sizeof(command) - 1);
+        while (!seen)
+        {
+            n = RS232_Read(port, buf, sizeof(buf));
+            seen = n > 0 && memchr(buf, '\n', n) != NULL; // Exactly one reply per command is outstanding
+        }
+    }
+    ReportLoopback("rs232", rs232_commands, started);
+    RS232_Close(port);
+
+    // serial.c opens a handle of its own, the rate probe is answered by the echo side
+    SetBaudCacheFile("");
+    if (SelectTransport("serial") || SetSerialDevice(device) || CanRS232PortBeOpened())
+    {
+        printf("{\"bench\":\"loopback\",\"skipped\":\"unable to open the serial transport\"}\n");
+        atomic_store(&echo_running, 0);
+        pthread_join(echo, NULL);
+        close(master);
+        return;
+    }
+    started = TimerMicros();
+    for (i = 0; i < serial_commands; i++)
+    {
+        PrintBuffer((char *)command);
+        WaitForReply();
+    }
+    ReportLoopback("serial", serial_commands, started);
+
+    atomic_store(&echo_running, 0);
+    pthread_join(echo, NULL);
+    CloseRS232Port();
+    close(master);
+}
+
+// The same serial.c loop over the tcp transport, a local socket answers in place of a bridge
+static void BenchTcpLoopback(void)
+{
+    static char command[] = "G1 X12.345 Y-67.890 F1000\n";
+    struct sockaddr_in address;
+    socklen_t length = sizeof(address);
+    char target[32];
+    pthread_t echo;
+    int listener, i;
+
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    if (listener == -1 || bind(listener, (struct sockaddr *)&address, sizeof(address)) || listen(listener, 1) ||
+        getsockname(listener, (struct sockaddr *)&address, &length))
+    {
+        printf("{\"bench\":\"loopback\",\"skipped\":\"unable to listen on a local socket\"}\n");
+        if (listener != -1)
+            close(listener);
+        return;
+    }
+    snprintf(target, sizeof(target), "127.0.0.1:%d", ntohs(address.sin_port));
+
+    // connect() completes against the backlog, the echo side accepts afterwards
+    if (SelectTransport("tcp") || SetSerialDevice(target) || CanRS232PortBeOpened() ||
+        (master = accept(listener, NULL, NULL)) == -1)
+    {
+        printf("{\"bench\":\"loopback\",\"skipped\":\"unable to connect to the local socket\"}\n");
+        close(listener);
+        return;
+    }
+    atomic_store(&echo_running, 1);
+    pthread_create(&echo, NULL, EchoController, NULL);
+
+    long long started = TimerMicros();
+    for (i = 0; i < serial_commands; i++)
+    {
+        PrintBuffer(command);
+        WaitForReply();
+    }
+    ReportLoopback("tcp", serial_commands, started);
+
+    atomic_store(&echo_running, 0);
+    pthread_join(echo, NULL);
+    CloseRS232Port();
+    close(master);
+    close(listener);
+}
+
+#else
+
+static void BenchLoopback(void)
+{
+    printf("{\"bench\":\"loopback\",\"skipped\":\"pseudo terminals are only available on Linux and FreeBSD\"}\n");
+}
+
+static void BenchTcpLoopback(void)
+{
+    printf("{\"bench\":\"loopback\",\"skipped\":\"the tcp loopback runs on Linux and FreeBSD\"}\n");
+}
+
+#endif
+
+// The same send and wait loop with nothing on the other end, the cost of the sender itself
+static void BenchNullTransport(void)
+{
+    static char command[] = "G1 X12.345 Y-67.890 F1000\n";
+    int i;
+
+    if (SelectTransport("null") || CanRS232PortBeOpened())
+        return;
+
+    long long started = TimerMicros();
+    for (i = 0; i < rs232_commands; i++)
+    {
+        PrintBuffer(command);
+        WaitForReply();
+    }
+    ReportLoopback("null", rs232_commands, started);
+    CloseRS232Port();
+}
+
+int main(int argc, char *argv[])
+{
+    int i;
+
+    LogSetOutput(stderr); // stdout carries only the JSON results
+    ParseSizes(BENCH_SIZES);
+
+    for (i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--font") && i + 1 < argc)
+            font_file = argv[++i];
+        else if (!strcmp(argv[i], "--sizes") && i + 1 < argc)
+        {
+            if (!ParseSizes(argv[++i]))
+            {
+                printf("Invalid size list: %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[i], "--threads") && i + 1 < argc)
+            thread_count = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--commands") && i + 1 < argc)
+            rs232_commands = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--serial-commands") && i + 1 < argc)
+            serial_commands = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--no-loopback"))
+            skip_loopback = 1;
+        else
+        {
+            printf("Usage: %s [--font <file>] [--sizes 1K,64K,1M] [--threads <n>] [--commands <n>]\n"
+                   "          [--serial-commands <n>] [--no-loopback]\n",
+                   argv[0]);
+            return 1;
+        }
+    }
+    if (rs232_commands < 1 || serial_commands < 1)
+    {
+        printf("Command counts must be positive\n");
+        return 1;
+    }
+
+    const Font *font = BenchFontParse();
+    BenchGlyphLookup(font);
+    BenchFormat();
+
+    int threads = thread_count > 0 ? thread_count : pool_default_threads();
+    ThreadPool *pool = threads > 1 ? pool_create(threads) : NULL;
+    for (i = 0; i < size_count; i++)
+        BenchGenerate(font, sizes[i], pool, pool ? threads : 1);
+    pool_destroy(pool);
+
+    BenchNullTransport();
+    if (!skip_loopback)
+    {
+        BenchLoopback();
+        BenchTcpLoopback();
+    }
+
+    return 0;
+}
@@ -0,0 +1,131 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "capture.h"
+#include "timer.h"
+
+// Trace layout: the 8 byte magic, then one record per read or write on the link:
+//   varint (time since previous record in us << 1 | direction)
+//   varint payload length
+//   payload bytes
+// Varints are little-endian base 128, so a typical ack costs 5 or 6 bytes on disk.
+
+static FILE *capture_file;
+static long long capture_last;
+static pthread_mutex_t capture_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void WriteVarint(FILE *file, unsigned long long value)
+{
+    while (value >= 0x80)
+    {
+        fputc((int)(value & 0x7F) | 0x80, file);
+        value >>= 7;
+    }
+    fputc((int)value, file);
+}
+
+static int ReadVarint(FILE *file, unsigned long long *value)
+{
+    int c, shift = 0;
+
+    *value = 0;
+    while ((c = fgetc(file)) != EOF)
+    {
+        *value |= (unsigned long long)(c & 0x7F) << shift;
+        if (!(c & 0x80))
+            return (1);
+        shift += 7;
+        if (shift > 63)
+            return (0);
+    }
+    return (0);
+}
+
+int StartCapture(const char *filename)
+{
+    FILE *file = fopen(filename, "wb");
+
+    if (!file)
+    {
+        printf("Unable to create capture file: %s\n", filename);
+        return (-1);
+    }
+
+    setvbuf(file, NULL, _IOFBF, 1 << 16); // Keep disk writes off the send path
+    fwrite(CAPTURE_MAGIC, 1, strlen(CAPTURE_MAGIC), file);
+
+    pthread_mutex_lock(&capture_lock);
+    capture_last = TimerMicros();
+    capture_file = file;
+    pthread_mutex_unlock(&capture_lock);
+    return (0);
+}
+
+// Called from the send and receive paths, possibly from several threads
+void CaptureBytes(int direction, const unsigned char *data, int length)
+{
+    long long now;
+
+    if (!capture_file || length <= 0)
+        return;
+
+    now = TimerMicros();
+
+    pthread_mutex_lock(&capture_lock);
+    if (capture_file)
+    {
+        while (length > 0)
+        {
+            int chunk = length < CAPTURE_MAX_RECORD ? length : CAPTURE_MAX_RECORD;
+            long long delta = now > capture_last ? now - capture_last : 0;
+
+            WriteVarint(capture_file, ((unsigned long long)delta << 1) | (unsigned)direction);
+            WriteVarint(capture_file, (unsigned long long)chunk);
+            fwrite(data, 1, chunk, capture_file);
+
+            capture_last += delta;
+            data += chunk;
+            length -= chunk;
+        }
+    }
+    pthread_mutex_unlock(&capture_lock);
+}
+
+void StopCapture(void)
+{
+    pthread_mutex_lock(&capture_lock);
+    if (capture_file)
+    {
+        fclose(capture_file);
+        capture_file = NULL;
+    }
+    pthread_mutex_unlock(&capture_lock);
+}
+
+int OpenCaptureTrace(FILE *file)
+{
+    char magic[sizeof(CAPTURE_MAGIC)];
+    size_t length = strlen(CAPTURE_MAGIC);
+
+    if (fread(magic, 1, length, file) != length || memcmp(magic, CAPTURE_MAGIC, length))
+        return (-1);
+    return (0);
+}
+
+// clock carries the running time between calls, start it at 0
+int ReadCaptureRecord(FILE *file, CaptureRecord *record, long long *clock)
+{
+    unsigned long long header, length;
+
+    if (!ReadVarint(file, &header) || !ReadVarint(file, &length) || length > CAPTURE_MAX_RECORD)
+        return (0);
+
+    *clock += (long long)(header >> 1);
+    record->direction = (int)(header & 1);
+    record->time = *clock;
+    record->length = (int)length;
+
+    return fread(record->data, 1, (size_t)length, file) == length;
+}
@@ -0,0 +1,28 @@
+#include <stdio.h>
+
+#ifndef CAPTURE_H_INCLUDED
+#define CAPTURE_H_INCLUDED
+
+#define CAPTURE_MAGIC "WRTRACE1" /* First bytes of every trace file */
+#define CAPTURE_MAX_RECORD 4096  /* Largest payload of a single record */
+
+#define CAPTURE_TX 0 /* Host to controller */
+#define CAPTURE_RX 1 /* Controller to host */
+
+// One decoded trace record
+typedef struct
+{
+    int direction;        // CAPTURE_TX or CAPTURE_RX
+    long long time;       // Microseconds since the capture started
+    int length;           // Payload bytes
+    unsigned char data[CAPTURE_MAX_RECORD];
+} CaptureRecord;
+
+int StartCapture(const char *filename);                                   // Begin logging link traffic, 0 on success
+void CaptureBytes(int direction, const unsigned char *data, int length); // Log bytes if a capture is running
+void StopCapture(void);                                                   // Flush and close the trace
+
+int OpenCaptureTrace(FILE *file);                           // Check the header of a trace, 0 if valid
+int ReadCaptureRecord(FILE *file, CaptureRecord *record, long long *clock); // Next record, 0 at end of trace
+
+#endif // CAPTURE_H_INCLUDED
@@ -0,0 +1,307 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "font.h"
+#include "layout.h"
+#include "generator.h"
+
+#define CORPUS_DIR "corpus"                  // Reference documents and their baselines
+#define CORPUS_BASELINES "baselines.txt"     // Inside the corpus directory
+#define CORPUS_SCALE 5                       // Scale the documents are generated at
+#define CORPUS_THRESHOLD 1.0                 // Percent a metric may grow before the check fails
+#define CORPUS_BATCH_LINES 4096              // Same batching as the sender
+#define CORPUS_MAX_DOCUMENTS 64
+#define CORPUS_NAME_SIZE 128
+
+// Generates every document of the corpus and compares how much motion it needs with the
+// stored baselines. Any metric growing by more than the threshold fails the check, so a
+// change that makes jobs longer cannot slip in unnoticed. --update records the new values.
+
+typedef struct
+{
+    long commands;
+    long long bytes;
+    long pen_lifts;
+    double pen_up_distance, pen_down_distance; // mm
+    long missing; // Characters without stroke data, reported but not compared
+} MotionCost;
+
+typedef struct
+{
+    char name[CORPUS_NAME_SIZE];
+    int has_baseline;
+    MotionCost baseline, measured;
+} CorpusEntry;
+
+static CorpusEntry entries[CORPUS_MAX_DOCUMENTS];
+static int entry_count;
+
+// Walk the generated commands the way the controller would and add up what they cost
+typedef struct
+{
+    MotionCost cost;
+    float x, y;
+    int pen_down;
+} MotionTally;
+
+static void tally_commands(MotionTally *tally, const char *text, size_t length)
+{
+    const char *end = text + length;
+
+    tally->cost.bytes += length;
+    while (text < end)
+    {
+        const char *newline = memchr(text, '\n', end - text);
+        const char *line_end = newline ? newline : end;
+        float x = tally->x, y = tally->y;
+        const char *p;
+
+        tally->cost.commands++;
+        if (text[0] == 'S')
+        {
+            int pen_down = atoi(text + 1) > 0;
+            if (tally->pen_down && !pen_down)
+                tally->cost.pen_lifts++;
+            tally->pen_down = pen_down;
+        }
+        else if (text[0] == 'G' && (text[1] == '0' || text[1] == '1') && text[2] == ' ')
+        {
+            for (p = text; p < line_end; p++)
+            {
+                if (*p == 'X')
+                    x = strtof(p + 1, NULL);
+                else if (*p == 'Y')
+                    y = strtof(p + 1, NULL);
+            }
+            double distance = hypot(x - tally->x, y - tally->y);
+            if (tally->pen_down)
+                tally->cost.pen_down_distance += distance;
+            else
+                tally->cost.pen_up_distance += distance;
+            tally->x = x;
+            tally->y = y;
+        }
+
+        text = newline ? newline + 1 : end;
+    }
+}
+
+static void tally_lines(MotionTally *tally, const Document *document, int line_count, const Font *font,
+                        CommandBlock *blocks)
+{
+    generate_lines(document, line_count, font, blocks, NULL);
+    for (int i = 0; i < line_count; i++)
+    {
+        tally_commands(tally, blocks[i].text ? blocks[i].text : "", blocks[i].length);
+        tally->cost.missing += blocks[i].missing;
+    }
+}
+
+// Lay out and generate a document as the sender would, 0 on success
+static int measure_document(const char *path, const Font *font, MotionCost *cost)
+{
+    static CommandBlock blocks[CORPUS_BATCH_LINES + 1];
+    static int blocks_ready;
+    MotionTally tally;
+    Document document;
+    char word[100];
+    FILE *input = fopen(path, "r");
+
+    if (!input)
+        return -1;
+    if (!blocks_ready)
+    {
+        for (int i = 0; i <= CORPUS_BATCH_LINES; i++)
+            block_init(&blocks[i]);
+        blocks_ready = 1;
+    }
+
+    memset(&tally, 0, sizeof(tally));
+    document_init(&document, CORPUS_SCALE / CHAR_WIDTH);
+    while (fscanf(input, "%99s", word) != EOF)
+    {
+        layout_word(&document, word);
+        if (document.line_count > CORPUS_BATCH_LINES)
+        {
+            tally_lines(&tally, &document, document.line_count - 1, font, blocks);
+            document_keep_open_line(&document);
+        }
+    }
+    tally_lines(&tally, &document, document.line_count, font, blocks);
+
+    document_free(&document);
+    fclose(input);
+    *cost = tally.cost;
+    return 0;
+}
+
+// One document per line: name, then its metrics unless it has no baseline yet
+static int read_baselines(const char *path)
+{
+    char line[512];
+    FILE *file = fopen(path, "r");
+
+    if (!file)
+    {
+        printf("Error opening file: %s\n", path);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), file))
+    {
+        CorpusEntry *entry = &entries[entry_count];
+        MotionCost *cost = &entry->baseline;
+
+        if (line[0] == '#' || sscanf(line, "%127s", entry->name) != 1)
+            continue;
+        if (entry_count == CORPUS_MAX_DOCUMENTS)
+        {
+            printf("Too many documents in %s, at most %d\n", path, CORPUS_MAX_DOCUMENTS);
+            break;
+        }
+        entry->has_baseline = sscanf(line, "%*s %ld %lld %ld %lf %lf", &cost->commands, &cost->bytes,
+                                     &cost->pen_lifts, &cost->pen_up_distance, &cost->pen_down_distance) == 5;
+        entry_count++;
+    }
+
+    fclose(file);
+    return 0;
+}
+
+static int write_baselines(const char *path)
+{
+    FILE *file = fopen(path, "w");
+
+    if (!file)
+    {
+        printf("Error writing file: %s\n", path);
+        return -1;
+    }
+
+    fprintf(file, "# Motion cost of each corpus document at scale %d, regenerate with corpus_check --update\n",
+            CORPUS_SCALE);
+    fprintf(file, "# document commands bytes pen_lifts pen_up_mm pen_down_mm\n");
+    for (int i = 0; i < entry_count; i++)
+    {
+        const MotionCost *cost = &entries[i].measured;
+        fprintf(file, "%s %ld %lld %ld %.2f %.2f\n", entries[i].name, cost->commands, cost->bytes, cost->pen_lifts,
+                cost->pen_up_distance, cost->pen_down_distance);
+    }
+
+    fclose(file);
+    return 0;
+}
+
+// Compare one metric, 1 if it grew past the threshold
+static int check_metric(const char *metric, double baseline, double measured, double threshold)
+{
+    double limit = baseline * (1 + threshold / 100) + 0.005; // Distances are stored to 0.01 mm
+    double change = baseline > 0 ? 100 * (measured - baseline) / baseline : 0;
+
+    if (measured > limit)
+    {
+        printf("    %s regressed: %.2f -> %.2f (%+.2f%%)\n", metric, baseline, measured, change);
+        return 1;
+    }
+    if (measured < baseline - 0.005)
+        printf("    %s improved: %.2f -> %.2f (%+.2f%%)\n", metric, baseline, measured, change);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    static DataEntry fontData[LINE_COUNT];
+    static Font loaded_font;
+    const Font *font = &embedded_font;
+    const char *corpus = CORPUS_DIR;
+    const char *font_file = NULL;
+    double threshold = CORPUS_THRESHOLD;
+    char path[1024], baselines[1024];
+    int update = 0, failures = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--corpus") && i + 1 < argc)
+            corpus = argv[++i];
+        else if (!strcmp(argv[i], "--font") && i + 1 < argc)
+            font_file = argv[++i];
+        else if (!strcmp(argv[i], "--threshold") && i + 1 < argc)
+            threshold = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--update"))
+            update = 1;
+        else
+        {
+            printf("Usage: %s [--corpus <dir>] [--font <file>] [--threshold <percent>] [--update]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    report_missing_glyphs = 0; // Counted per document instead
+    if (snprintf(baselines, sizeof(baselines), "%s/%s", corpus, CORPUS_BASELINES) >= (int)sizeof(baselines))
+    {
+        printf("Corpus path too long: %s\n", corpus);
+        return 1;
+    }
+    if (read_baselines(baselines))
+        return 1;
+    if (font_file)
+    {
+        if (load_font(font_file, fontData))
+            return 1;
+        index_font(&loaded_font, fontData);
+        font = &loaded_font;
+    }
+
+    for (int i = 0; i < entry_count; i++)
+    {
+        CorpusEntry *entry = &entries[i];
+        const MotionCost *cost = &entry->measured;
+
+        if (snprintf(path, sizeof(path), "%s/%s", corpus, entry->name) >= (int)sizeof(path) ||
+            measure_document(path, font, &entry->measured))
+        {
+            printf("%s: missing\n", entry->name);
+            failures++;
+            continue;
+        }
+
+        printf("%s: %ld commands, %lld bytes, %ld pen lifts, %.2f mm pen up, %.2f mm pen down\n", entry->name,
+               cost->commands, cost->bytes, cost->pen_lifts, cost->pen_up_distance, cost->pen_down_distance);
+        if (cost->missing)
+            printf("    %ld characters without stroke data were skipped\n", cost->missing);
+        if (update)
+            continue;
+        if (!entry->has_baseline)
+        {
+            printf("    no baseline, run with --update to record one\n");
+            failures++;
+            continue;
+        }
+
+        const MotionCost *base = &entry->baseline;
+        failures += check_metric("commands", base->commands, cost->commands, threshold) +
+                    check_metric("bytes", (double)base->bytes, (double)cost->bytes, threshold) +
+                    check_metric("pen lifts", base->pen_lifts, cost->pen_lifts, threshold) +
+                    check_metric("pen up mm", base->pen_up_distance, cost->pen_up_distance, threshold) +
+                    check_metric("pen down mm", base->pen_down_distance, cost->pen_down_distance, threshold);
+    }
+
+    if (update)
+    {
+        if (failures || write_baselines(baselines))
+            return 1;
+        printf("Baselines updated in %s\n", baselines);
+        return 0;
+    }
+
+    if (failures)
+    {
+        printf("%d regression%s against %s (threshold %.2f%%)\n", failures, failures == 1 ? "" : "s", baselines,
+               threshold);
+        return 1;
+    }
+    printf("All %d documents within %.2f%% of their baselines\n", entry_count, threshold);
+    return 0;
+}
@@ -0,0 +1,64 @@
+#include <math.h>
+
+#include "feed.h"
+
+// Function to reset the planner to the origin with no feed emitted yet
+void feed_planner_init(FeedPlanner *planner)
+{
+    planner->x = 0;
+    planner->y = 0;
+    planner->current_feed = 0;
+}
+
+// Function to pick the drawing feed for a pen-down segment.
+// The peak speed a segment can reach from and back to rest is sqrt(a * length), so a short
+// stroke gets the feed it can actually hold. The feed is then cut in proportion to how sharply
+// the path turns into the next segment (next may be NULL at the end of a stroke).
+static int draw_feed(float dx, float dy, const float *next, float x, float y)
+{
+#if ADAPTIVE_FEED
+    float length = sqrtf(dx * dx + dy * dy);
+    float feed = 60.0F * sqrtf(FEED_ACCELERATION * length);
+
+    if (feed > DRAW_FEED_MAX)
+        feed = DRAW_FEED_MAX;
+
+    if (next && length > 0)
+    {
+        float nx = next[0] - x, ny = next[1] - y;
+        float next_length = sqrtf(nx * nx + ny * ny);
+        if (next_length > 0)
+        {
+            float turn_cos = (dx * nx + dy * ny) / (length * next_length); // 1 straight on, -1 reversal
+            feed *= 0.5F + 0.5F * turn_cos;
+        }
+    }
+
+    if (feed < DRAW_FEED_MIN)
+        feed = DRAW_FEED_MIN;
+
+    return (int)(feed / FEED_STEP + 0.5F) * FEED_STEP;
+#else
+    (void)dx;
+    (void)dy;
+    (void)next;
+    (void)x;
+    (void)y;
+    return DRAW_FEED;
+#endif
+}
+
+// Function to plan the feed of a move to (x, y) and return the F word value, 0 if unchanged
+int feed_for_move(FeedPlanner *planner, int pen_down, float x, float y, const float *next)
+{
+    int feed = pen_down ? draw_feed(x - planner->x, y - planner->y, next, x, y) : TRAVEL_FEED;
+
+    planner->x = x;
+    planner->y = y;
+
+    if (feed == planner->current_feed)
+        return 0;
+
+    planner->current_feed = feed;
+    return feed;
+}
@@ -0,0 +1,22 @@
+#ifndef FEED_H_INCLUDED
+#define FEED_H_INCLUDED
+
+#define TRAVEL_FEED 3000       // Feed for pen-up moves (mm/min)
+#define DRAW_FEED 1000         // Feed for pen-down moves when adaptive feed is off (mm/min)
+#define ADAPTIVE_FEED 1        // 1 = scale the drawing feed with segment length and corner angle
+#define DRAW_FEED_MIN 400      // Slowest adaptive drawing feed (mm/min)
+#define DRAW_FEED_MAX 2000     // Fastest adaptive drawing feed (mm/min)
+#define FEED_ACCELERATION 250  // Controller acceleration used to estimate reachable speed (mm/s^2)
+#define FEED_STEP 100          // Feeds are rounded to this, so tiny changes emit no new F word
+
+// Tracks the pen position and the feed last sent so F words are only emitted on change
+typedef struct
+{
+    float x, y;       // Position after the last planned move
+    int current_feed; // Feed last emitted, 0 before the first move
+} FeedPlanner;
+
+void feed_planner_init(FeedPlanner *planner);
+int feed_for_move(FeedPlanner *planner, int pen_down, float x, float y, const float *next); // F word to emit, 0 if unchanged
+
+#endif // FEED_H_INCLUDED
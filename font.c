@@ -0,0 +1,58 @@
+#include <stdio.h>
+
+#include "font.h"
+
+// Function to read the font data file into fontData
+int load_font(const char *filename, DataEntry *fontData)
+{
+    FILE *fontFile = fopen(filename, "r");
+    if (!fontFile)
+    {
+        printf("Error opening file: %s\n", filename);
+        return -1;
+    }
+
+    for (int i = 0; i < LINE_COUNT; i++)
+    {
+        if (fscanf(fontFile, "%f %f %d", &fontData[i].Xposition, &fontData[i].Yposition, &fontData[i].Zposition) != 3)
+        {
+            fontData[i].Xposition = fontData[i].Yposition = 0; // Unused tail of the table
+            fontData[i].Zposition = 0;
+        }
+    }
+    fclose(fontFile);
+    return 0;
+}
+
+// Function to index the characters of loaded font data, each header is 999, its ASCII value and stroke count
+void index_font(Font *font, const DataEntry *fontData)
+{
+    font->entries = fontData;
+    for (int i = 0; i < FONT_GLYPHS; i++)
+    {
+        font->glyph_start[i] = -1;
+        font->glyph_strokes[i] = 0;
+    }
+
+    for (int i = 0; i < LINE_COUNT; i++)
+    {
+        int ascii_val = (int)fontData[i].Yposition;
+        if (fontData[i].Xposition == 999 && ascii_val >= 0 && ascii_val < FONT_GLYPHS &&
+            font->glyph_start[ascii_val] < 0) // The first header wins, as with the old linear search
+        {
+            font->glyph_start[ascii_val] = (short)(i + 1);
+            font->glyph_strokes[ascii_val] = (short)fontData[i].Zposition;
+        }
+    }
+}
+
+// Function to find the stroke data for a specific character
+const DataEntry *find_character_data(char character, const Font *font, int *stroke_count)
+{
+    unsigned char ascii_val = (unsigned char)character; // Get ASCII value of the character
+    if (ascii_val >= FONT_GLYPHS || font->glyph_start[ascii_val] < 0)
+        return NULL; // Character data not found
+
+    *stroke_count = font->glyph_strokes[ascii_val];     // Get stroke count
+    return &font->entries[font->glyph_start[ascii_val]]; // Return pointer to the first stroke data
+}
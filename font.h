@@ -0,0 +1,29 @@
+#ifndef FONT_H_INCLUDED
+#define FONT_H_INCLUDED
+
+#define LINE_COUNT 1027 // Number of lines in the font data file
+#define FONT_GLYPHS 128 // Characters a font can hold, ASCII
+
+// Struct to hold font data for each character
+typedef struct
+{
+    float Xposition;
+    float Yposition;
+    int Zposition;
+} DataEntry;
+
+// Font data with each character's strokes found up front
+typedef struct
+{
+    const DataEntry *entries;        // LINE_COUNT entries laid out as in the font file
+    short glyph_start[FONT_GLYPHS];  // Entry of each character's first stroke, -1 if the font lacks it
+    short glyph_strokes[FONT_GLYPHS];
+} Font;
+
+extern const Font embedded_font; // SingleStrokeFont.txt, compiled in by the build (font_data.c)
+
+int load_font(const char *filename, DataEntry *fontData);        // 0 on success
+void index_font(Font *font, const DataEntry *fontData);          // Point font at fontData and index its characters
+const DataEntry *find_character_data(char character, const Font *font, int *stroke_count); // NULL if missing
+
+#endif // FONT_H_INCLUDED
@@ -0,0 +1,52 @@
+#include <stdio.h>
+
+#include "font.h"
+
+// Build step: turns a font file into C source for embedded_font, so the sender starts
+// without reading or parsing anything. Run as fontgen <font file> <output .c file>.
+
+int main(int argc, char *argv[])
+{
+    static DataEntry fontData[LINE_COUNT];
+    Font font;
+    FILE *output;
+    int i;
+
+    if (argc != 3)
+    {
+        printf("Usage: %s <font file> <output .c file>\n", argv[0]);
+        return 1;
+    }
+    if (load_font(argv[1], fontData))
+        return 1;
+    index_font(&font, fontData);
+
+    output = fopen(argv[2], "w");
+    if (!output)
+    {
+        printf("Unable to create output file: %s\n", argv[2]);
+        return 1;
+    }
+
+    fprintf(output, "// Generated by fontgen from %s, do not edit\n\n#include \"font.h\"\n\n", argv[1]);
+    fprintf(output, "static const DataEntry entries[LINE_COUNT] = {\n");
+    for (i = 0; i < LINE_COUNT; i++)
+    {
+        fprintf(output, "    {%.9g, %.9g, %d},\n", fontData[i].Xposition, fontData[i].Yposition,
+                fontData[i].Zposition);
+    }
+    fprintf(output, "};\n\nconst Font embedded_font = {\n    entries,\n    {");
+    for (i = 0; i < FONT_GLYPHS; i++)
+        fprintf(output, "%s%d", i ? (i % 16 ? ", " : ",\n     ") : "", font.glyph_start[i]);
+    fprintf(output, "},\n    {");
+    for (i = 0; i < FONT_GLYPHS; i++)
+        fprintf(output, "%s%d", i ? (i % 16 ? ", " : ",\n     ") : "", font.glyph_strokes[i]);
+    fprintf(output, "}};\n");
+
+    if (fclose(output))
+    {
+        printf("Unable to write output file: %s\n", argv[2]);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,410 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "generator.h"
+#include "trace.h"
+
+Dialect output_dialect = DIALECT_GCODE;
+int report_missing_glyphs = 1;
+
+void block_init(CommandBlock *block)
+{
+    block->text = NULL;
+    block->length = block->capacity = 0;
+    block->commands = 0;
+    block->tags = NULL;
+    block->tag_capacity = 0;
+    block->missing = 0;
+}
+
+void block_clear(CommandBlock *block)
+{
+    block->length = 0;
+    block->commands = 0;
+    block->missing = 0;
+}
+
+void block_free(CommandBlock *block)
+{
+    free(block->text);
+    free(block->tags);
+    block_init(block);
+}
+
+// Function to record which glyph produced the commands added since first_command
+void block_tag(CommandBlock *block, int first_command, int glyph)
+{
+    if (block->commands > block->tag_capacity)
+    {
+        int capacity = block->tag_capacity ? block->tag_capacity : 1024;
+        while (capacity < block->commands)
+            capacity *= 2;
+        block->tags = realloc(block->tags, capacity);
+        if (!block->tags)
+        {
+            printf("Out of memory during generation\n");
+            exit(1);
+        }
+        block->tag_capacity = capacity;
+    }
+    memset(block->tags + first_command, glyph, block->commands - first_command);
+}
+
+// Function to add commands to a block, counting the lines added
+void block_append(CommandBlock *block, const char *text, size_t length)
+{
+    if (block->length + length + 1 > block->capacity)
+    {
+        size_t capacity = block->capacity ? block->capacity * 2 : 4096;
+        while (capacity < block->length + length + 1)
+            capacity *= 2;
+        block->text = realloc(block->text, capacity);
+        if (!block->text)
+        {
+            printf("Out of memory during generation\n");
+            exit(1);
+        }
+        block->capacity = capacity;
+    }
+
+    memcpy(block->text + block->length, text, length);
+    block->length += length;
+    block->text[block->length] = 0;
+
+    for (size_t i = 0; i < length; i++)
+        block->commands += text[i] == '\n';
+}
+
+// Function to format a move with a known feed, 0 for no F word.
+// Travel is a G1 as well: Grbl ignores F on G0, so TRAVEL_FEED only takes effect on a G1.
+void format_feed_move(char *buffer, float x, float y, int feed)
+{
+    int length = sprintf(buffer, "G1 X%.2f Y%.2f", x, y);
+    if (feed)
+        length += sprintf(buffer + length, " F%d", feed);
+    strcpy(buffer + length, "\n");
+}
+
+// Function to format a move, adding the F word only when the feed changes
+void format_move(FeedPlanner *planner, char *buffer, int pen_down, float x, float y, const float *next)
+{
+    format_feed_move(buffer, x, y, feed_for_move(planner, pen_down, x, y, next));
+}
+
+// Function to format a pen change followed by a controller-side dwell while the servo settles.
+// The wait runs in the controller's planner, so strokes between pen changes stream back to back.
+int format_pen(MotionState *motion, char *buffer, int pen_down)
+{
+    float dwell = pen_down ? PEN_DROP_DWELL : PEN_LIFT_DWELL;
+    int length;
+
+    if (pen_down == motion->pen_down)
+    {
+        buffer[0] = 0;
+        return 0;
+    }
+
+    motion->pen_down = pen_down;
+    length = sprintf(buffer, "S%d\n", pen_down ? PEN_DOWN_POWER : 0);
+    if (dwell > 0)
+        length += sprintf(buffer + length, "G4 P%.2f\n", dwell);
+    return length;
+}
+
+int dialect_from_name(const char *name)
+{
+    if (!strcmp(name, "gcode"))
+        return DIALECT_GCODE;
+    if (!strcmp(name, "hpgl"))
+        return DIALECT_HPGL;
+    return -1;
+}
+
+// Function to format the commands that start a job: the pen raised at the origin
+int format_job_start(char *buffer)
+{
+    FeedPlanner planner;
+    int length;
+
+    if (output_dialect == DIALECT_HPGL)
+        return sprintf(buffer, "IN;\nSP1;\nPU0,0;\n");
+
+    feed_planner_init(&planner);
+    format_move(&planner, buffer, 0, 0, 0, NULL); // Travel to the origin, this also sets the first feed
+    length = (int)strlen(buffer);
+    return length + sprintf(buffer + length, "M3\nS0\n");
+}
+
+// Function to format the commands that end a job back at the origin
+int format_job_end(char *buffer)
+{
+    FeedPlanner planner;
+
+    if (output_dialect == DIALECT_HPGL)
+        return sprintf(buffer, "PU0,0;\nSP0;\n");
+
+    feed_planner_init(&planner);
+    format_move(&planner, buffer, 0, 0, 0, NULL);
+    return (int)strlen(buffer);
+}
+
+// Function to end the open HP-GL point list
+static void hpgl_close(MotionState *motion, CommandBlock *block)
+{
+    if (!motion->points)
+        return;
+    block_append(block, ";\n", 2);
+    motion->points = 0;
+}
+
+// Function to add a point to the HP-GL list for the pen state. A PD list is one polyline,
+// only the end of a run of pen-up moves matters so a PU list keeps just its last point.
+// Text runs down from y = 0, plotters clip below their origin, so Y is moved up by HPGL_TOP.
+static void hpgl_move(MotionState *motion, CommandBlock *block, int pen_down, float x, float y)
+{
+    long px = lroundf(x * HPGL_UNITS_PER_MM), py = lroundf((y + HPGL_TOP) * HPGL_UNITS_PER_MM);
+    char buffer[48];
+    int length;
+
+    motion->feed.x = x;
+    motion->feed.y = y;
+
+    if (motion->points && (pen_down != motion->pen_down || motion->points == HPGL_MAX_POINTS))
+        hpgl_close(motion, block);
+    if (motion->points && px == motion->last_x && py == motion->last_y)
+        return; // Same plotter unit as the point before
+
+    if (motion->points && !pen_down)
+    {
+        block->length = motion->last_point; // Replace the earlier travel point
+        motion->points--;
+    }
+
+    motion->last_point = block->length;
+    if (motion->points)
+        length = sprintf(buffer, ",%ld,%ld", px, py);
+    else
+        length = sprintf(buffer, "%s%ld,%ld", pen_down ? "PD" : "PU", px, py);
+    block_append(block, buffer, length);
+
+    motion->points++;
+    motion->pen_down = pen_down;
+    motion->last_x = px;
+    motion->last_y = py;
+}
+
+// Function to add a move whose feed is already planned, such as one played back from a job file
+void emit_planned_move(MotionState *motion, CommandBlock *block, int pen_down, float x, float y, int feed)
+{
+    char buffer[100];
+
+    if (output_dialect == DIALECT_HPGL)
+    {
+        hpgl_move(motion, block, pen_down, x, y);
+        return;
+    }
+
+    int length = format_pen(motion, buffer, pen_down); // Pen state, when it changes
+    format_feed_move(buffer + length, x, y, feed);
+    block_append(block, buffer, strlen(buffer));
+}
+
+// Function to add a move to a block in the output dialect, with the pen change before it
+void emit_move(MotionState *motion, CommandBlock *block, int pen_down, float x, float y, const float *next)
+{
+    int feed = output_dialect == DIALECT_HPGL ? 0 : feed_for_move(&motion->feed, pen_down, x, y, next);
+    emit_planned_move(motion, block, pen_down, x, y, feed);
+}
+
+// Function to end a block with the pen raised, so the next block can start on its own
+int emit_pen_up(MotionState *motion, CommandBlock *block)
+{
+    char buffer[100];
+
+    if (output_dialect == DIALECT_HPGL)
+    {
+        int was_down = motion->pen_down;
+        if (motion->points && !was_down)
+        {
+            // Only a travel is open. The next block and the job end each start with a travel of
+            // their own, so drop it, the way job playback merges it into the one after.
+            block->length = motion->last_point;
+            block->text[block->length] = 0;
+            motion->points = 0;
+        }
+        hpgl_close(motion, block);
+        if (was_down)
+            block_append(block, "PU;\n", 4);
+        motion->pen_down = 0;
+        return was_down;
+    }
+
+    if (!format_pen(motion, buffer, 0))
+        return 0;
+    block_append(block, buffer, strlen(buffer));
+    return 1;
+}
+
+// Function to generate G-code commands for a word
+void generate_gcode_for_word(const char *word, const Font *font, float scaleFactor, float *current_Xpos,
+                             float current_Ypos, MotionState *motion, CommandBlock *block)
+{
+    for (int i = 0; word[i]; i++)
+    { // Process each character in the word
+        int stroke_count;
+        size_t first_byte = block->length;
+        int first_command = block->commands;
+        double up = 0, down = 0;
+        int pen_changes = 0;
+        const DataEntry *charData = find_character_data(word[i], font, &stroke_count);
+        if (charData)
+        {
+            for (int j = 0; j < stroke_count; j++)
+            { // Generate G-code for each stroke
+                float scaledX = (charData[j].Xposition * scaleFactor) + *current_Xpos;
+                float scaledY = (charData[j].Yposition * scaleFactor) + current_Ypos;
+                float next[2], *nextPoint = NULL; // Following pen-down point, for corner slowdown
+                if (charData[j].Zposition && j + 1 < stroke_count && charData[j + 1].Zposition)
+                {
+                    next[0] = (charData[j + 1].Xposition * scaleFactor) + *current_Xpos;
+                    next[1] = (charData[j + 1].Yposition * scaleFactor) + current_Ypos;
+                    nextPoint = next;
+                }
+                if (motion->profile)
+                {
+                    double distance = hypot(scaledX - motion->feed.x, scaledY - motion->feed.y);
+                    *(charData[j].Zposition ? &down : &up) += distance;
+                }
+                pen_changes += (charData[j].Zposition != 0) != motion->pen_down;
+                emit_move(motion, block, charData[j].Zposition != 0, scaledX, scaledY, nextPoint);
+            }
+        }
+        else
+        {
+            block->missing++;
+            if (report_missing_glyphs)
+                printf("Character '%c' - Stroke data not found.\n", word[i]);
+        }
+        *current_Xpos += CHAR_WIDTH * scaleFactor; // Advance to next character position
+
+        if (motion->profile)
+        {
+            GlyphCost *cost = &motion->profile->glyphs[(unsigned char)word[i]];
+            cost->occurrences++;
+            cost->commands += block->commands - first_command;
+            cost->bytes += block->length - first_byte;
+            cost->pen_changes += pen_changes;
+            cost->pen_up_distance += up;
+            cost->pen_down_distance += down;
+            block_tag(block, first_command, (unsigned char)word[i]);
+        }
+    }
+}
+
+// Function to charge the commands added since first_command to the travel bucket
+static void charge_other(GlyphProfile *profile, CommandBlock *block, size_t first_byte, int first_command)
+{
+    GlyphCost *cost = &profile->glyphs[PROFILE_OTHER];
+    cost->commands += block->commands - first_command;
+    cost->bytes += block->length - first_byte;
+    block_tag(block, first_command, PROFILE_OTHER);
+}
+
+// Function to generate one laid-out line. Every line starts from a fresh feed planner with
+// the pen up and ends with the pen up, so its block does not depend on the lines before it
+// and can be built on any thread.
+void generate_line(const Document *document, int line, const Font *font, CommandBlock *block)
+{
+    const LayoutLine *layoutLine = &document->lines[line];
+    MotionState motion;
+
+    block_clear(block);
+    feed_planner_init(&motion.feed);
+    motion.feed.x = layoutLine->start_x;
+    motion.feed.y = layoutLine->start_y;
+    motion.pen_down = 0;
+    motion.points = 0;
+    motion.profile = profile_enabled ? calloc(1, sizeof(GlyphProfile)) : NULL; // Merged once per line
+    if (profile_enabled && !motion.profile)
+    {
+        printf("Out of memory during generation\n");
+        exit(1);
+    }
+
+    if (layoutLine->travel)
+    {
+        if (motion.profile)
+            motion.profile->glyphs[PROFILE_OTHER].pen_up_distance +=
+                hypot(layoutLine->start_x, layoutLine->y - layoutLine->start_y);
+        emit_move(&motion, block, 0, 0, layoutLine->y, NULL); // Move to the new line
+        if (motion.profile)
+            charge_other(motion.profile, block, 0, 0);
+    }
+
+    for (int i = 0; i < layoutLine->word_count; i++)
+    {
+        const LayoutWord *word = &document->words[layoutLine->first_word + i];
+        float current_Xpos = word->x;
+        long long span = TraceBeginDetail();
+        generate_gcode_for_word(document->text + word->text, font, document->scaleFactor, &current_Xpos,
+                                layoutLine->y, &motion, block);
+        TraceEnd("generate", "generate word", span, document->text + word->text, -1);
+    }
+
+    size_t first_byte = block->length;
+    int first_command = block->commands;
+    int lifted = emit_pen_up(&motion, block);
+
+    if (motion.profile)
+    {
+        motion.profile->glyphs[PROFILE_OTHER].pen_changes += lifted;
+        charge_other(motion.profile, block, first_byte, first_command);
+        profile_merge(motion.profile);
+        free(motion.profile);
+    }
+}
+
+typedef struct
+{
+    const Document *document;
+    const Font *font;
+    CommandBlock *blocks;
+    const int *lines; // Lines to generate, NULL for all of them
+} GenerateJob;
+
+static void generate_task(int index, void *context)
+{
+    GenerateJob *job = context;
+    int line = job->lines ? job->lines[index] : index;
+    generate_line(job->document, line, job->font, &job->blocks[line]);
+}
+
+static void run_job(GenerateJob *job, int count, ThreadPool *pool)
+{
+    if (pool && count > 1)
+    {
+        pool_run(pool, count, generate_task, job);
+        return;
+    }
+
+    for (int i = 0; i < count; i++)
+        generate_task(i, job);
+}
+
+// Function to generate a run of lines, each into its own block so they can be emitted in order
+void generate_lines(const Document *document, int line_count, const Font *font, CommandBlock *blocks,
+                    ThreadPool *pool)
+{
+    GenerateJob job = {document, font, blocks, NULL};
+    run_job(&job, line_count, pool);
+}
+
+// Function to generate only some of the lines, such as those a cache could not supply
+void generate_selected_lines(const Document *document, const int *lines, int count, const Font *font,
+                             CommandBlock *blocks, ThreadPool *pool)
+{
+    GenerateJob job = {document, font, blocks, lines};
+    run_job(&job, count, pool);
+}
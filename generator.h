@@ -0,0 +1,77 @@
+#include <stddef.h>
+
+#include "font.h"
+#include "layout.h"
+#include "feed.h"
+#include "pool.h"
+#include "profile.h"
+
+#ifndef GENERATOR_H_INCLUDED
+#define GENERATOR_H_INCLUDED
+
+#define PEN_DOWN_POWER 1000  // S value that lowers the pen, S0 raises it
+#define PEN_DROP_DWELL 0.15F // Seconds the controller waits after lowering the pen, 0 for none
+#define PEN_LIFT_DWELL 0.10F // Seconds the controller waits after raising the pen, 0 for none
+
+#define HPGL_UNITS_PER_MM 40 // HP-GL plotter units are 0.025 mm
+#define HPGL_MAX_POINTS 32   // Points in one PU or PD list, plotters buffer a limited instruction
+#define HPGL_TOP 280         // mm above the plotter origin where the text starts, near the top of an A4 sheet
+
+// Command language of the output
+typedef enum
+{
+    DIALECT_GCODE, // One G1 per point, S pen changes with G4 dwells
+    DIALECT_HPGL   // PU travel and PD polylines as point lists, integer plotter units
+} Dialect;
+
+extern Dialect output_dialect; // Set once before generation starts
+extern int report_missing_glyphs; // Print each character the font has no strokes for, set before generation
+
+// Motion state carried from move to move within a block
+typedef struct
+{
+    FeedPlanner feed;
+    int pen_down;          // Pen state after the last move
+    GlyphProfile *profile; // Per-line cost attribution, NULL when not profiling
+    int points;            // HP-GL points in the open list, 0 if none is open
+    size_t last_point;     // Block length before the last point of the open list
+    long last_x, last_y;   // That point in plotter units
+} MotionState;
+
+// Commands generated for one line, newline separated
+typedef struct
+{
+    char *text;
+    size_t length, capacity;
+    int commands;        // Number of command lines in text
+    unsigned char *tags; // Glyph that produced each command, only filled when profiling
+    int tag_capacity;
+    int missing;         // Characters skipped because the font has no strokes for them
+} CommandBlock;
+
+void block_init(CommandBlock *block);
+void block_clear(CommandBlock *block);
+void block_free(CommandBlock *block);
+void block_append(CommandBlock *block, const char *text, size_t length);
+void block_tag(CommandBlock *block, int first_command, int glyph); // Tag commands [first_command, commands)
+
+int dialect_from_name(const char *name);      // gcode or hpgl, -1 if unknown
+int format_job_start(char *buffer);           // Commands that start a job, returns the length
+int format_job_end(char *buffer);             // Commands that end it back at the origin
+void emit_move(MotionState *motion, CommandBlock *block, int pen_down, float x, float y,
+               const float *next);                        // A move in the output dialect, pen change included
+void emit_planned_move(MotionState *motion, CommandBlock *block, int pen_down, float x, float y,
+                       int feed);                          // Same with the feed given, 0 for unchanged
+int emit_pen_up(MotionState *motion, CommandBlock *block); // Close the block with the pen up, 1 if it was down
+void format_move(FeedPlanner *planner, char *buffer, int pen_down, float x, float y, const float *next);
+void format_feed_move(char *buffer, float x, float y, int feed); // No F word when feed is 0
+int format_pen(MotionState *motion, char *buffer, int pen_down); // Pen change and dwell, 0 bytes if unchanged
+void generate_gcode_for_word(const char *word, const Font *font, float scaleFactor, float *current_Xpos,
+                             float current_Ypos, MotionState *motion, CommandBlock *block);
+void generate_line(const Document *document, int line, const Font *font, CommandBlock *block);
+void generate_lines(const Document *document, int line_count, const Font *font, CommandBlock *blocks,
+                    ThreadPool *pool); // Lines [0, line_count) into blocks[], in parallel when pool is set
+void generate_selected_lines(const Document *document, const int *lines, int count, const Font *font,
+                             CommandBlock *blocks, ThreadPool *pool); // lines[0..count) into blocks[line]
+
+#endif // GENERATOR_H_INCLUDED
@@ -0,0 +1,345 @@
+#define _FILE_OFFSET_BITS 64 /* Files past 2 GB on 32-bit systems */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "job.h"
+#include "generator.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+struct JobWriter
+{
+    FILE *file;
+    const char *filename;
+    JobHeader header;
+    JobRun run;             // Open run, moves == 0 when there is none
+    unsigned char *packed;  // Its packed moves after the first
+    int32_t x, y;           // Last move, job units
+    int pen_down;           // Pen state from the last S command
+    int feed;               // Feed in effect, mm/min
+    int failed;
+};
+
+JobWriter *job_writer_open(const char *filename)
+{
+    JobWriter *writer = calloc(1, sizeof(JobWriter));
+
+    if (!writer || !(writer->packed = malloc((size_t)JOB_RUN_MOVES * JOB_MOVE_SIZE)))
+    {
+        printf("Out of memory for the job file\n");
+        free(writer);
+        return NULL;
+    }
+    writer->file = fopen(filename, "wb");
+    if (!writer->file)
+    {
+        printf("Unable to create job file: %s\n", filename);
+        free(writer->packed);
+        free(writer);
+        return NULL;
+    }
+    writer->filename = filename;
+    memcpy(writer->header.magic, JOB_MAGIC, sizeof(writer->header.magic));
+    writer->header.version = JOB_VERSION;
+    fwrite(&writer->header, sizeof(JobHeader), 1, writer->file); // Rewritten with the totals at the end
+    return writer;
+}
+
+static void close_run(JobWriter *writer)
+{
+    if (!writer->run.moves)
+        return;
+    fwrite(&writer->run, sizeof(JobRun), 1, writer->file);
+    fwrite(writer->packed, JOB_MOVE_SIZE, writer->run.moves - 1, writer->file);
+    writer->header.runs++;
+    writer->run.moves = 0;
+}
+
+// Add one move, a new run starts when the pen changed, the run is full or the delta does not fit
+static void add_move(JobWriter *writer, int32_t x, int32_t y, int feed)
+{
+    int32_t dx = x - writer->x, dy = y - writer->y;
+    int pen_down = writer->pen_down;
+
+    if (writer->run.moves &&
+        (writer->run.pen_down != pen_down || writer->run.moves == JOB_RUN_MOVES || dx != (int16_t)dx ||
+         dy != (int16_t)dy))
+        close_run(writer);
+
+    if (!writer->run.moves)
+    {
+        writer->run.pen_down = (uint8_t)pen_down;
+        writer->run.feed = (uint8_t)(feed / FEED_STEP);
+        writer->run.x = x;
+        writer->run.y = y;
+    }
+    else
+    {
+        int16_t delta[2] = {(int16_t)dx, (int16_t)dy};
+        unsigned char *move = writer->packed + (size_t)(writer->run.moves - 1) * JOB_MOVE_SIZE;
+        memcpy(move, delta, sizeof(delta));
+        move[4] = (unsigned char)(feed / FEED_STEP);
+    }
+    writer->run.moves++;
+
+    if (feed)
+        writer->feed = feed;
+    double distance = hypot(dx, dy) / JOB_UNITS_PER_MM;
+    *(pen_down ? &writer->header.draw_mm : &writer->header.travel_mm) += distance;
+    if (writer->feed)
+        writer->header.seconds += distance * 60 / writer->feed;
+    writer->header.moves++;
+    writer->x = x;
+    writer->y = y;
+}
+
+static void add_command(JobWriter *writer, const char *text, const char *end)
+{
+    if (text[0] == 'S')
+    {
+        int pen_down = atoi(text + 1) > 0;
+        if (pen_down != writer->pen_down)
+        {
+            writer->header.pen_lifts += !pen_down;
+            writer->header.seconds += pen_down ? PEN_DROP_DWELL : PEN_LIFT_DWELL;
+        }
+        writer->pen_down = pen_down;
+        return;
+    }
+    if (text[0] == 'G' && text[1] == '4' && text[2] == ' ')
+        return; // The dwell after a pen change, the player writes it again
+    if (text[0] == 'G' && (text[1] == '0' || text[1] == '1') && text[2] == ' ')
+    {
+        double x = writer->x / (double)JOB_UNITS_PER_MM, y = writer->y / (double)JOB_UNITS_PER_MM;
+        int feed = 0;
+
+        for (const char *p = text; p < end; p++)
+        {
+            if (*p == 'X')
+                x = strtod(p + 1, NULL);
+            else if (*p == 'Y')
+                y = strtod(p + 1, NULL);
+            else if (*p == 'F')
+                feed = atoi(p + 1);
+        }
+        if (feed % FEED_STEP == 0 && feed / FEED_STEP <= UINT8_MAX)
+        {
+            add_move(writer, (int32_t)lround(x * JOB_UNITS_PER_MM), (int32_t)lround(y * JOB_UNITS_PER_MM), feed);
+            return;
+        }
+    }
+
+    printf("The job file cannot hold the command: %.*s\n", (int)(end - text), text);
+    writer->failed = 1;
+}
+
+void job_writer_add(JobWriter *writer, const char *text, size_t length)
+{
+    const char *end = text + length;
+
+    while (text < end && !writer->failed)
+    {
+        const char *newline = memchr(text, '\n', end - text);
+        const char *line_end = newline ? newline : end;
+
+        if (line_end > text)
+            add_command(writer, text, line_end);
+        text = newline ? newline + 1 : end;
+    }
+}
+
+int job_writer_close(JobWriter *writer)
+{
+    int result = writer->failed ? -1 : 0;
+    long long size = 0;
+
+    close_run(writer);
+    if (fseek(writer->file, 0, SEEK_SET) || fwrite(&writer->header, sizeof(JobHeader), 1, writer->file) != 1)
+        result = -1;
+    else if (!fseek(writer->file, 0, SEEK_END))
+        size = ftell(writer->file);
+    if (fclose(writer->file))
+        result = -1;
+
+    if (result)
+        printf("Unable to write the job file: %s\n", writer->filename);
+    else
+        printf("Job written to %s: %llu moves in %u runs, %lld bytes, about %.0f s to draw\n", writer->filename,
+               (unsigned long long)writer->header.moves, writer->header.runs, size, writer->header.seconds);
+
+    free(writer->packed);
+    free(writer);
+    return result;
+}
+
+// A whole job file mapped into memory, jobs are small enough to map at once
+typedef struct
+{
+#ifdef _WIN32
+    HANDLE file, mapping;
+#else
+    int fd;
+#endif
+    const unsigned char *data;
+    long long size;
+} JobMap;
+
+static int map_job(JobMap *map, const char *filename)
+{
+    memset(map, 0, sizeof(*map));
+#ifdef _WIN32
+    LARGE_INTEGER size;
+
+    map->file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                            FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (map->file == INVALID_HANDLE_VALUE)
+        return -1;
+    if (!GetFileSizeEx(map->file, &size) || size.QuadPart < (long long)sizeof(JobHeader) ||
+        !(map->mapping = CreateFileMappingA(map->file, NULL, PAGE_READONLY, 0, 0, NULL)) ||
+        !(map->data = MapViewOfFile(map->mapping, FILE_MAP_READ, 0, 0, 0)))
+    {
+        if (map->mapping)
+            CloseHandle(map->mapping);
+        CloseHandle(map->file);
+        return -1;
+    }
+    map->size = size.QuadPart;
+#else
+    struct stat info;
+
+    map->fd = open(filename, O_RDONLY);
+    if (map->fd == -1)
+        return -1;
+    if (fstat(map->fd, &info) || info.st_size < (off_t)sizeof(JobHeader))
+    {
+        close(map->fd);
+        return -1;
+    }
+    void *data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, map->fd, 0);
+    if (data == MAP_FAILED)
+    {
+        close(map->fd);
+        return -1;
+    }
+#ifdef MADV_SEQUENTIAL
+    madvise(data, info.st_size, MADV_SEQUENTIAL);
+#endif
+    map->data = data;
+    map->size = info.st_size;
+#endif
+    return 0;
+}
+
+static void unmap_job(JobMap *map)
+{
+#ifdef _WIN32
+    UnmapViewOfFile(map->data);
+    CloseHandle(map->mapping);
+    CloseHandle(map->file);
+#else
+    munmap((void *)map->data, map->size);
+    close(map->fd);
+#endif
+}
+
+// Hand on the complete lines of the block and keep the unfinished HP-GL point list, if any
+static void flush_lines(CommandBlock *block, MotionState *motion, JobEmit emit)
+{
+    size_t complete = block->length;
+
+    while (complete && block->text[complete - 1] != '\n')
+        complete--;
+    if (!complete)
+        return;
+
+    emit(block->text, complete);
+    memmove(block->text, block->text + complete, block->length - complete);
+    block->length -= complete;
+    block->commands = 0;
+    if (motion->points)
+        motion->last_point -= complete; // The open list starts after the last newline
+}
+
+int job_play(const char *filename, JobEmit emit)
+{
+    JobMap map;
+    JobHeader header;
+    CommandBlock block;
+    MotionState motion;
+
+    if (map_job(&map, filename))
+    {
+        printf("Error opening file: %s\n", filename);
+        return -1;
+    }
+    memcpy(&header, map.data, sizeof(header));
+    if (memcmp(header.magic, JOB_MAGIC, sizeof(header.magic)) || header.version != JOB_VERSION)
+    {
+        printf("Not a job file: %s\n", filename);
+        unmap_job(&map);
+        return -1;
+    }
+    printf("Job %s: %llu moves, %llu pen lifts, %.0f mm drawn, %.0f mm travelled, about %.0f s\n", filename,
+           (unsigned long long)header.moves, (unsigned long long)header.pen_lifts, header.draw_mm, header.travel_mm,
+           header.seconds);
+
+    block_init(&block);
+    feed_planner_init(&motion.feed);
+    motion.pen_down = 0;
+    motion.points = 0;
+    motion.profile = NULL;
+
+    const unsigned char *p = map.data + sizeof(JobHeader), *end = map.data + map.size;
+    int failed = 0;
+    for (uint32_t i = 0; i < header.runs; i++)
+    {
+        JobRun run;
+
+        if (end - p < (long long)sizeof(JobRun))
+        {
+            failed = 1;
+            break;
+        }
+        memcpy(&run, p, sizeof(run));
+        p += sizeof(run);
+        if (!run.moves || end - p < (long long)(run.moves - 1) * JOB_MOVE_SIZE)
+        {
+            failed = 1;
+            break;
+        }
+
+        int32_t x = run.x, y = run.y;
+        emit_planned_move(&motion, &block, run.pen_down, (float)x / JOB_UNITS_PER_MM, (float)y / JOB_UNITS_PER_MM,
+                          run.feed * FEED_STEP);
+        for (int j = 1; j < run.moves; j++, p += JOB_MOVE_SIZE)
+        {
+            int16_t delta[2];
+            memcpy(delta, p, sizeof(delta));
+            x += delta[0];
+            y += delta[1];
+            emit_planned_move(&motion, &block, run.pen_down, (float)x / JOB_UNITS_PER_MM,
+                              (float)y / JOB_UNITS_PER_MM, p[4] * FEED_STEP);
+        }
+
+        if (block.length >= JOB_PLAY_CHUNK)
+            flush_lines(&block, &motion, emit);
+    }
+    emit_pen_up(&motion, &block);
+    flush_lines(&block, &motion, emit);
+
+    if (failed)
+        printf("Job file %s is cut short, playback stopped\n", filename);
+    block_free(&block);
+    unmap_job(&map);
+    return failed ? -1 : 0;
+}
@@ -0,0 +1,46 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef JOB_H_INCLUDED
+#define JOB_H_INCLUDED
+
+#define JOB_MAGIC "WRJOB001"  /* First bytes of every job file */
+#define JOB_VERSION 1         /* Bump when the layout below changes */
+#define JOB_UNITS_PER_MM 100  // Coordinates are stored in hundredths of a mm, the resolution of the G-code
+#define JOB_RUN_MOVES 65535   // Longest run, a longer one is split
+#define JOB_MOVE_SIZE 5       // Bytes per packed move: X and Y deltas, then the feed
+#define JOB_PLAY_CHUNK 65536  // Bytes of commands serialized before they are handed on
+
+// A job file is the header, then pen-state runs. Each run is a JobRun holding its first
+// move, followed by (moves - 1) packed moves: int16 X and Y deltas from the move before in
+// job units and a uint8 feed in FEED_STEP units, 0 when unchanged. Pen changes, dwells and
+// the job's start and end are not stored, the player writes them in the chosen dialect.
+// Values are in host byte order, like the line cache.
+typedef struct
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t runs;
+    uint64_t moves;
+    uint64_t pen_lifts;
+    double draw_mm, travel_mm;
+    double seconds; // Estimated drawing time at the planned feeds, dwells included
+} JobHeader;
+
+typedef struct
+{
+    uint8_t pen_down;
+    uint8_t feed;   // Of the first move, FEED_STEP units, 0 when unchanged
+    uint16_t moves; // The first included
+    int32_t x, y;   // First move, job units
+} JobRun;
+
+typedef struct JobWriter JobWriter;
+typedef void (*JobEmit)(const char *text, size_t length); // Receives whole command lines
+
+JobWriter *job_writer_open(const char *filename); // NULL on failure
+void job_writer_add(JobWriter *writer, const char *text, size_t length); // Generated G-code commands
+int job_writer_close(JobWriter *writer); // Write the header totals and print them, 0 on success
+int job_play(const char *filename, JobEmit emit); // Map a job and serialize it in output_dialect, 0 on success
+
+#endif // JOB_H_INCLUDED
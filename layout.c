@@ -0,0 +1,160 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "layout.h"
+
+// Function to calculate the width of a word
+float calculate_word_width(const char *word, float scaleFactor)
+{
+    return (float)strlen(word) * CHAR_WIDTH * scaleFactor; // Width based on scaled character width
+}
+
+// Function to check if a word fits in the remaining line space
+int fits_in_line(double *remaining_space, float word_width)
+{
+    if (*remaining_space >= word_width)
+    {
+        *remaining_space -= word_width; // Update remaining space
+        return 1;                       // Word fits
+    }
+    return 0; // Word doesn't fit
+}
+
+// Function to grow an array so it can hold at least count + 1 items
+static void *reserve(void *items, int count, int *capacity, size_t item_size)
+{
+    if (count < *capacity)
+        return items;
+
+    *capacity = *capacity ? *capacity * 2 : 256;
+    items = realloc(items, (size_t)*capacity * item_size);
+    if (!items)
+    {
+        printf("Out of memory during layout\n");
+        exit(1);
+    }
+    return items;
+}
+
+// Function to start a new line at the current position, the pen is coming from (from_x, from_y)
+static void open_line(Document *document, int travel, float from_x, float from_y)
+{
+    document->lines = reserve(document->lines, document->line_count, &document->line_capacity, sizeof(LayoutLine));
+    LayoutLine *line = &document->lines[document->line_count++];
+    line->first_word = document->word_count;
+    line->word_count = 0;
+    line->y = document->current_Ypos;
+    line->travel = travel;
+    line->start_x = from_x;
+    line->start_y = from_y;
+}
+
+// Function to set up an empty document with the first line open
+void document_init(Document *document, float scaleFactor)
+{
+    memset(document, 0, sizeof(*document));
+    document->scaleFactor = scaleFactor;
+    document->remaining_space = LINE_WIDTH;
+    document->current_Xpos = 0;
+    document->current_Ypos = LINE_SPACING - CHAR_WIDTH * scaleFactor;
+    open_line(document, 0, 0, 0); // The job starts at the origin
+}
+
+void document_free(Document *document)
+{
+    free(document->words);
+    free(document->text);
+    free(document->lines);
+    memset(document, 0, sizeof(*document));
+}
+
+const char *document_word(const Document *document, int word)
+{
+    return document->text + document->words[word].text;
+}
+
+// Function to move down and open the next line
+static void next_line(Document *document)
+{
+    float scaleFactor = document->scaleFactor;
+
+    // The pen ends where the last character advanced to, before the trailing space
+    int has_words = document->lines[document->line_count - 1].word_count > 0;
+    float from_x = document->current_Xpos - (has_words ? CHAR_WIDTH * scaleFactor : 0);
+    float from_y = document->current_Ypos;
+
+    document->current_Xpos = 0;                                        // Reset X-position
+    document->current_Ypos += LINE_SPACING - CHAR_WIDTH * scaleFactor; // Move to the next line
+    document->remaining_space = LINE_WIDTH;                            // Reset remaining space for the new line
+    open_line(document, 1, from_x, from_y);
+}
+
+// Function to end the open line early, 1 if it had words and a new line was opened
+int document_break_line(Document *document)
+{
+    if (!document->lines[document->line_count - 1].word_count)
+        return 0;
+    next_line(document);
+    return 1;
+}
+
+// Function to place a word, moving to a new line when it does not fit
+int layout_word(Document *document, const char *word)
+{
+    float scaleFactor = document->scaleFactor;
+    float wordWidth = calculate_word_width(word, scaleFactor);
+    int new_line = 0;
+
+    if (!fits_in_line(&document->remaining_space, wordWidth))
+    {
+        next_line(document);
+        new_line = 1;
+    }
+
+    size_t length = strlen(word) + 1;
+    while (document->text_length + length > document->text_capacity)
+    {
+        document->text_capacity = document->text_capacity ? document->text_capacity * 2 : 4096;
+        document->text = realloc(document->text, document->text_capacity);
+        if (!document->text)
+        {
+            printf("Out of memory during layout\n");
+            exit(1);
+        }
+    }
+    memcpy(document->text + document->text_length, word, length);
+
+    document->words = reserve(document->words, document->word_count, &document->word_capacity, sizeof(LayoutWord));
+    document->words[document->word_count].text = document->text_length;
+    document->words[document->word_count].x = document->current_Xpos;
+    document->word_count++;
+    document->lines[document->line_count - 1].word_count++;
+    document->text_length += length;
+
+    // Advance one character at a time, exactly as generation does
+    for (size_t i = 0; i + 1 < length; i++)
+        document->current_Xpos += CHAR_WIDTH * scaleFactor;
+    document->current_Xpos += CHAR_WIDTH * scaleFactor; // Space after the word
+    document->remaining_space -= CHAR_WIDTH * scaleFactor;
+
+    return new_line;
+}
+
+// Function to forget the completed lines once they have been generated
+void document_keep_open_line(Document *document)
+{
+    LayoutLine *open = &document->lines[document->line_count - 1];
+    size_t text_start = open->word_count ? document->words[open->first_word].text : document->text_length;
+
+    memmove(document->words, document->words + open->first_word, (size_t)open->word_count * sizeof(LayoutWord));
+    for (int i = 0; i < open->word_count; i++)
+        document->words[i].text -= text_start;
+    memmove(document->text, document->text + text_start, document->text_length - text_start);
+
+    document->text_length -= text_start;
+    document->word_count = open->word_count;
+    document->lines[0] = *open;
+    document->lines[0].first_word = 0;
+    document->line_count = 1;
+}
@@ -0,0 +1,53 @@
+#include <stddef.h>
+
+#ifndef LAYOUT_H_INCLUDED
+#define LAYOUT_H_INCLUDED
+
+#define LINE_WIDTH 100   // Width of each line for text placement
+#define CHAR_WIDTH 18.0F // Width of each character in the font
+#define LINE_SPACING -5  // Vertical spacing between lines
+
+// A word placed on a line, its text lives in the document's text pool
+typedef struct
+{
+    size_t text; // Offset of the NUL-terminated word in Document.text
+    float x;     // X position of the first character
+} LayoutWord;
+
+// A laid-out line of words
+typedef struct
+{
+    int first_word; // Index of the first word in Document.words
+    int word_count;
+    float y;                // Baseline of the line
+    int travel;             // 1 if the pen travels to the start of this line before drawing it
+    float start_x, start_y; // Where the pen is when the line begins
+} LayoutLine;
+
+// Text laid out into lines. Layout is sequential, but once a line is complete
+// its words and positions are all that is needed to generate it.
+typedef struct
+{
+    float scaleFactor;
+    double remaining_space; // Space left on the open (last) line
+    float current_Xpos, current_Ypos;
+
+    LayoutWord *words;
+    int word_count, word_capacity;
+    char *text;
+    size_t text_length, text_capacity;
+    LayoutLine *lines;
+    int line_count, line_capacity;
+} Document;
+
+float calculate_word_width(const char *word, float scaleFactor);
+int fits_in_line(double *remaining_space, float word_width);
+
+void document_init(Document *document, float scaleFactor);
+void document_free(Document *document);
+int layout_word(Document *document, const char *word);     // Place a word, 1 if it opened a new line
+int document_break_line(Document *document);               // Close the open line early, 1 if it had words
+void document_keep_open_line(Document *document);          // Drop every line but the open one
+const char *document_word(const Document *document, int word); // Text of a word
+
+#endif // LAYOUT_H_INCLUDED
@@ -0,0 +1,340 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "linecache.h"
+
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+typedef struct
+{
+    uint64_t key;
+    size_t offset;          // Description in LineCache.data, the commands follow it
+    uint32_t source_length; // Bytes of description
+    uint32_t length;        // Bytes of commands
+    int commands;
+    int occupied;
+    int used; // Fetched or stored this job, kept when the file is rewritten
+} CacheEntry;
+
+struct LineCache
+{
+    const char *filename;
+    uint64_t seed; // Hash of the font, the scale and the generator settings
+    CacheEntry *entries;
+    int entry_count, capacity; // capacity is a power of two
+    char *data;
+    size_t data_length, data_capacity;
+    long hits, misses;
+};
+
+// FNV-1a, continued from hash
+static uint64_t hash_bytes(uint64_t hash, const void *bytes, size_t length)
+{
+    const unsigned char *p = bytes;
+
+    for (size_t i = 0; i < length; i++)
+    {
+        hash ^= p[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+static uint64_t hash_float(uint64_t hash, float value)
+{
+    return hash_bytes(hash, &value, sizeof(value));
+}
+
+static uint64_t hash_int(uint64_t hash, int value)
+{
+    return hash_bytes(hash, &value, sizeof(value));
+}
+
+static void *grow(void *items, size_t size)
+{
+    items = realloc(items, size);
+    if (!items)
+    {
+        printf("Out of memory in the line cache\n");
+        exit(1);
+    }
+    return items;
+}
+
+// The entry holding this description, or the free slot for it
+static CacheEntry *find_slot(LineCache *cache, uint64_t key, const char *source, uint32_t source_length)
+{
+    int mask = cache->capacity - 1;
+    int slot = (int)(key & mask);
+
+    for (;; slot = (slot + 1) & mask)
+    {
+        CacheEntry *entry = &cache->entries[slot];
+
+        if (!entry->occupied)
+            return entry;
+        if (entry->key == key && entry->source_length == source_length &&
+            !memcmp(cache->data + entry->offset, source, source_length))
+            return entry;
+    }
+}
+
+// Keep the table at most half full
+static void reserve_entry(LineCache *cache)
+{
+    if ((cache->entry_count + 1) * 2 <= cache->capacity)
+        return;
+
+    CacheEntry *old = cache->entries;
+    int old_capacity = cache->capacity;
+
+    cache->capacity = old_capacity ? old_capacity * 2 : 1024;
+    cache->entries = calloc(cache->capacity, sizeof(CacheEntry));
+    if (!cache->entries)
+    {
+        printf("Out of memory in the line cache\n");
+        exit(1);
+    }
+    for (int i = 0; i < old_capacity; i++)
+    {
+        if (old[i].occupied)
+            *find_slot(cache, old[i].key, cache->data + old[i].offset, old[i].source_length) = old[i];
+    }
+    free(old);
+}
+
+static CacheEntry *insert(LineCache *cache, const LineSource *source, const char *text, uint32_t length,
+                          int commands)
+{
+    size_t size = source->length + length;
+
+    reserve_entry(cache);
+    CacheEntry *entry = find_slot(cache, source->key, source->text, (uint32_t)source->length);
+
+    if (cache->data_length + size > cache->data_capacity)
+    {
+        size_t capacity = cache->data_capacity ? cache->data_capacity * 2 : 1 << 20;
+        while (capacity < cache->data_length + size)
+            capacity *= 2;
+        cache->data = grow(cache->data, capacity);
+        cache->data_capacity = capacity;
+    }
+    memcpy(cache->data + cache->data_length, source->text, source->length);
+    memcpy(cache->data + cache->data_length + source->length, text, length);
+
+    if (!entry->occupied)
+        cache->entry_count++;
+    entry->key = source->key;
+    entry->offset = cache->data_length;
+    entry->source_length = (uint32_t)source->length;
+    entry->length = length;
+    entry->commands = commands;
+    entry->occupied = 1;
+    entry->used = 0;
+    cache->data_length += size;
+    return entry;
+}
+
+// Read the entries of an earlier job, a missing or damaged file just leaves the cache short
+static void load_entries(LineCache *cache, FILE *file)
+{
+    char magic[sizeof(CACHE_MAGIC) - 1];
+    uint32_t header[3]; // Description length, command length and commands
+    LineSource source = {0};
+    char *text = NULL;
+    size_t text_capacity = 0;
+
+    if (fread(magic, 1, sizeof(magic), file) != sizeof(magic) || memcmp(magic, CACHE_MAGIC, sizeof(magic)))
+    {
+        printf("Ignoring %s, it is not a line cache\n", cache->filename);
+        return;
+    }
+
+    while (fread(&source.key, sizeof(source.key), 1, file) == 1 && fread(header, sizeof(header), 1, file) == 1)
+    {
+        if (header[0] > source.capacity)
+        {
+            source.capacity = header[0];
+            source.text = grow(source.text, source.capacity);
+        }
+        if (header[1] > text_capacity)
+        {
+            text_capacity = header[1];
+            text = grow(text, text_capacity);
+        }
+        source.length = header[0];
+        if (fread(source.text, 1, header[0], file) != header[0] || fread(text, 1, header[1], file) != header[1])
+            break; // Cut short, keep what was complete
+        insert(cache, &source, text, header[1], (int)header[2]);
+    }
+    free(source.text);
+    free(text);
+}
+
+LineCache *line_cache_open(const char *filename, const Font *font, float scaleFactor)
+{
+    LineCache *cache = calloc(1, sizeof(LineCache));
+    FILE *file;
+
+    if (!cache)
+        return NULL;
+    cache->filename = filename;
+
+    // Anything that changes every block of a job goes into the seed
+    uint64_t seed = hash_int(FNV_OFFSET, CACHE_VERSION);
+    seed = hash_bytes(seed, font->entries, LINE_COUNT * sizeof(DataEntry));
+    seed = hash_float(seed, scaleFactor);
+    seed = hash_int(seed, PEN_DOWN_POWER);
+    seed = hash_float(seed, PEN_DROP_DWELL);
+    seed = hash_float(seed, PEN_LIFT_DWELL);
+    seed = hash_int(seed, TRAVEL_FEED);
+    seed = hash_int(seed, DRAW_FEED);
+    seed = hash_int(seed, ADAPTIVE_FEED);
+    seed = hash_int(seed, DRAW_FEED_MIN);
+    seed = hash_int(seed, DRAW_FEED_MAX);
+    seed = hash_int(seed, FEED_ACCELERATION);
+    seed = hash_int(seed, FEED_STEP);
+    seed = hash_int(seed, output_dialect);
+    cache->seed = seed;
+
+    reserve_entry(cache);
+    file = fopen(filename, "rb");
+    if (file)
+    {
+        load_entries(cache, file);
+        fclose(file);
+    }
+    return cache;
+}
+
+static void describe_bytes(LineSource *source, const void *bytes, size_t length)
+{
+    if (source->length + length > source->capacity)
+    {
+        source->capacity = source->capacity ? source->capacity * 2 : 256;
+        while (source->capacity < source->length + length)
+            source->capacity *= 2;
+        source->text = grow(source->text, source->capacity);
+    }
+    memcpy(source->text + source->length, bytes, length);
+    source->length += length;
+}
+
+static void describe_float(LineSource *source, float value)
+{
+    describe_bytes(source, &value, sizeof(value));
+}
+
+// Everything generate_line reads from the document for this line. The baseline is part of
+// it: every coordinate is rounded after the baseline is added, so a block generated at one
+// baseline cannot be moved to another and still match a fresh run byte for byte.
+void line_cache_describe(const LineCache *cache, const Document *document, int line, LineSource *source)
+{
+    const LayoutLine *layoutLine = &document->lines[line];
+
+    source->length = 0;
+    describe_bytes(source, &layoutLine->travel, sizeof(layoutLine->travel));
+    describe_float(source, layoutLine->start_x);
+    describe_float(source, layoutLine->start_y);
+    describe_float(source, layoutLine->y);
+    for (int i = 0; i < layoutLine->word_count; i++)
+    {
+        const LayoutWord *word = &document->words[layoutLine->first_word + i];
+        const char *text = document->text + word->text;
+
+        describe_float(source, word->x);
+        describe_bytes(source, text, strlen(text) + 1);
+    }
+    source->key = hash_bytes(cache->seed, source->text, source->length);
+}
+
+int line_cache_fetch(LineCache *cache, const LineSource *source, CommandBlock *block)
+{
+    CacheEntry *entry = find_slot(cache, source->key, source->text, (uint32_t)source->length);
+
+    if (!entry->occupied)
+    {
+        cache->misses++;
+        return 0;
+    }
+
+    block_clear(block);
+    block_append(block, cache->data + entry->offset + entry->source_length, entry->length);
+    block->commands = entry->commands;
+    entry->used = 1;
+    cache->hits++;
+    return 1;
+}
+
+void line_cache_store(LineCache *cache, const LineSource *source, const CommandBlock *block)
+{
+    insert(cache, source, block->text ? block->text : "", (uint32_t)block->length, block->commands)->used = 1;
+}
+
+// Fill lines [0, line_count) from the cache and generate the rest, in parallel when pool is set
+void line_cache_generate(LineCache *cache, const Document *document, int line_count, const Font *font,
+                         CommandBlock *blocks, ThreadPool *pool)
+{
+    LineSource *sources = calloc(line_count ? line_count : 1, sizeof(LineSource));
+    int *missing = calloc(line_count ? line_count : 1, sizeof(int));
+    int missing_count = 0;
+
+    if (!sources || !missing)
+    {
+        printf("Out of memory in the line cache\n");
+        exit(1);
+    }
+    for (int i = 0; i < line_count; i++)
+    {
+        line_cache_describe(cache, document, i, &sources[i]);
+        if (!line_cache_fetch(cache, &sources[i], &blocks[i]))
+            missing[missing_count++] = i;
+    }
+
+    generate_selected_lines(document, missing, missing_count, font, blocks, pool);
+    for (int i = 0; i < missing_count; i++)
+        line_cache_store(cache, &sources[missing[i]], &blocks[missing[i]]);
+
+    for (int i = 0; i < line_count; i++)
+        free(sources[i].text);
+    free(sources);
+    free(missing);
+}
+
+int line_cache_close(LineCache *cache)
+{
+    FILE *file = fopen(cache->filename, "wb");
+    int result = 0;
+    long lines = cache->hits + cache->misses;
+
+    if (file)
+    {
+        fwrite(CACHE_MAGIC, 1, sizeof(CACHE_MAGIC) - 1, file);
+        for (int i = 0; i < cache->capacity; i++)
+        {
+            const CacheEntry *entry = &cache->entries[i];
+            uint32_t header[3] = {entry->source_length, entry->length, (uint32_t)entry->commands};
+
+            if (!entry->occupied || !entry->used)
+                continue;
+            fwrite(&entry->key, sizeof(entry->key), 1, file);
+            fwrite(header, sizeof(header), 1, file);
+            fwrite(cache->data + entry->offset, 1, entry->source_length + entry->length, file);
+        }
+    }
+    if (!file || fclose(file))
+    {
+        printf("Unable to write the line cache: %s\n", cache->filename);
+        result = -1;
+    }
+
+    printf("Line cache: %ld of %ld lines reused (%.1f%%), %ld generated\n", cache->hits, lines,
+           lines ? 100.0 * cache->hits / lines : 0.0, cache->misses);
+
+    free(cache->entries);
+    free(cache->data);
+    free(cache);
+    return result;
+}
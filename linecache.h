@@ -0,0 +1,34 @@
+#include <stdint.h>
+
+#include "generator.h"
+
+#ifndef LINECACHE_H_INCLUDED
+#define LINECACHE_H_INCLUDED
+
+#define CACHE_MAGIC "WRCACHE3" /* First bytes of every cache file */
+#define CACHE_VERSION 3        /* Bump when generation changes, old entries then never match */
+
+// Command blocks of previously generated lines, keyed by a hash of everything the block
+// depends on: the font, the scale and generator settings, the line's pen start, its
+// baseline and its words. The entry keeps that description and a hit must match it byte for
+// byte, the hash only finds the slot.
+// Loaded whole at the start of a job and rewritten at the end with the lines it used.
+typedef struct LineCache LineCache;
+
+// What a line's block is generated from, in a form that can be compared
+typedef struct
+{
+    uint64_t key;   // Hash of the cache seed and the description
+    char *text;     // Description bytes
+    size_t length, capacity;
+} LineSource;
+
+LineCache *line_cache_open(const char *filename, const Font *font, float scaleFactor); // NULL on failure
+void line_cache_describe(const LineCache *cache, const Document *document, int line, LineSource *source);
+int line_cache_fetch(LineCache *cache, const LineSource *source, CommandBlock *block); // 1 and the block on a hit
+void line_cache_store(LineCache *cache, const LineSource *source, const CommandBlock *block);
+void line_cache_generate(LineCache *cache, const Document *document, int line_count, const Font *font,
+                         CommandBlock *blocks, ThreadPool *pool); // generate_lines, reusing cached blocks
+int line_cache_close(LineCache *cache); // Write the lines used this job and print the hit rate, 0 on success
+
+#endif // LINECACHE_H_INCLUDED
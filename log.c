@@ -0,0 +1,225 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "log.h"
+#include "serial.h"
+#include "timer.h"
+
+// Producers on any thread claim a slot in a bounded ring with a single compare-and-swap and
+// copy their bytes in, the writer thread formats and prints them later. A full ring drops
+// the record and counts it rather than ever blocking the send or receive path.
+// Each slot carries a sequence number: equal to its position when free, position + 1 once
+// filled, so producers and the writer agree on ownership without locks.
+
+typedef struct
+{
+    atomic_size_t sequence;
+    long long time;   // TimerMicros() when logged
+    const char *tag;  // Static string such as "sent", NULL for plain text
+    int level;
+    int length;       // Original length
+    int kept;         // Bytes of it stored in text
+    char text[LOG_TEXT_SIZE];
+} LogRecord;
+
+static LogRecord ring[LOG_RING_SIZE];
+static atomic_size_t enqueue_position;
+static size_t dequeue_position; // Only the writer thread touches this
+static atomic_int log_level = LOG_INFO;
+static atomic_ulong dropped;
+static atomic_int writer_running;
+static pthread_t writer_thread;
+static long long log_origin;
+static FILE *log_output; // NULL for stdout
+
+static const char *level_names[] = {"error", "warn", "info", "debug"};
+
+int LogLevelFromName(const char *name)
+{
+    for (int i = LOG_ERROR; i <= LOG_DEBUG; i++)
+    {
+        if (!strcmp(name, level_names[i]))
+            return i;
+    }
+    return (-1);
+}
+
+void LogSetLevel(int level)
+{
+    atomic_store_explicit(&log_level, level, memory_order_relaxed);
+}
+
+void LogSetOutput(FILE *file)
+{
+    log_output = file;
+}
+
+int LogEnabled(int level)
+{
+    return level <= atomic_load_explicit(&log_level, memory_order_relaxed);
+}
+
+// Print one record, replacing unreadable control codes by dots
+static void WriteRecord(long long time, const char *tag, int level, const char *text, int kept, int length)
+{
+    char line[LOG_TEXT_SIZE + 64];
+
+    if (!log_origin)
+        log_origin = time;
+
+    int n = sprintf(line, "[%9.3f] %s", (time - log_origin) / 1e6, level <= LOG_WARN ? (level ? "warning: " : "error: ") : "");
+
+    if (tag)
+        n += sprintf(line + n, "%s %d bytes: ", tag, length);
+    for (int i = 0; i < kept; i++)
+        line[n++] = (unsigned char)text[i] < 32 ? '.' : text[i];
+    if (kept < length)
+        n += sprintf(line + n, "...");
+    line[n++] = '\n';
+
+    fwrite(line, 1, n, log_output ? log_output : stdout);
+}
+
+static void Enqueue(int level, const char *tag, const char *text, int kept, int length)
+{
+    LogRecord *record;
+    size_t position = atomic_load_explicit(&enqueue_position, memory_order_relaxed);
+
+    if (!atomic_load_explicit(&writer_running, memory_order_acquire))
+    {
+        WriteRecord(TimerMicros(), tag, level, text, kept, length); // No writer yet, print directly
+        return;
+    }
+
+    while (1)
+    {
+        record = &ring[position & (LOG_RING_SIZE - 1)];
+        size_t sequence = atomic_load_explicit(&record->sequence, memory_order_acquire);
+        long difference = (long)sequence - (long)position;
+
+        if (difference == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&enqueue_position, &position, position + 1,
+                                                      memory_order_relaxed, memory_order_relaxed))
+                break;
+        }
+        else if (difference < 0)
+        {
+            atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed); // Ring full
+            return;
+        }
+        else
+        {
+            position = atomic_load_explicit(&enqueue_position, memory_order_relaxed);
+        }
+    }
+
+    record->time = TimerMicros();
+    record->tag = tag;
+    record->level = level;
+    record->length = length;
+    record->kept = kept;
+    memcpy(record->text, text, kept);
+    atomic_store_explicit(&record->sequence, position + 1, memory_order_release);
+}
+
+void LogBytes(int level, const char *tag, const void *data, int length)
+{
+    if (!LogEnabled(level))
+        return;
+
+    Enqueue(level, tag, data, length < LOG_TEXT_SIZE ? length : LOG_TEXT_SIZE, length);
+}
+
+void LogPrintf(int level, const char *format, ...)
+{
+    char text[LOG_TEXT_SIZE];
+    va_list args;
+    int length;
+
+    if (!LogEnabled(level))
+        return;
+
+    va_start(args, format);
+    length = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+
+    if (length < 0)
+        return;
+    Enqueue(level, NULL, text, length < LOG_TEXT_SIZE ? length : LOG_TEXT_SIZE - 1, length);
+}
+
+// Write out every filled record, returns how many there were
+static int Drain(void)
+{
+    int count = 0;
+
+    while (1)
+    {
+        LogRecord *record = &ring[dequeue_position & (LOG_RING_SIZE - 1)];
+        if (atomic_load_explicit(&record->sequence, memory_order_acquire) != dequeue_position + 1)
+            break;
+
+        WriteRecord(record->time, record->tag, record->level, record->text, record->kept, record->length);
+        atomic_store_explicit(&record->sequence, dequeue_position + LOG_RING_SIZE, memory_order_release);
+        dequeue_position++;
+        count++;
+    }
+
+    unsigned long lost = atomic_exchange_explicit(&dropped, 0, memory_order_relaxed);
+    if (lost)
+        fprintf(log_output ? log_output : stdout, "[log] %lu records dropped, ring full\n", lost);
+    if (count)
+        fflush(log_output ? log_output : stdout);
+
+    return count;
+}
+
+static void *WriterMain(void *unused)
+{
+    (void)unused;
+
+    while (atomic_load_explicit(&writer_running, memory_order_acquire))
+    {
+        if (!Drain())
+            Sleep(LOG_IDLE_MS);
+    }
+    Drain();
+    return NULL;
+}
+
+int LogStart(int level)
+{
+    LogSetLevel(level);
+    if (!log_origin)
+        log_origin = TimerMicros();
+
+    if (atomic_load(&writer_running))
+        return (0);
+
+    for (size_t i = 0; i < LOG_RING_SIZE; i++)
+        atomic_init(&ring[i].sequence, i);
+    atomic_store(&enqueue_position, 0);
+    dequeue_position = 0;
+
+    atomic_store(&writer_running, 1);
+    if (pthread_create(&writer_thread, NULL, WriterMain, NULL))
+    {
+        atomic_store(&writer_running, 0);
+        printf("Unable to start the log writer, logging synchronously\n");
+        return (-1);
+    }
+    return (0);
+}
+
+void LogStop(void)
+{
+    if (!atomic_exchange(&writer_running, 0))
+        return;
+
+    pthread_join(writer_thread, NULL);
+}
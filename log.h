@@ -0,0 +1,25 @@
+#include <stdio.h>
+
+#ifndef LOG_H_INCLUDED
+#define LOG_H_INCLUDED
+
+#define LOG_RING_SIZE 4096 /* Records in flight, must be a power of two */
+// A record holds a numbered line (LINE_FRAMED_SIZE in serial.h) with the reply it got
+#define LOG_TEXT_SIZE 384  /* Bytes of payload kept per record, longer data is truncated */
+#define LOG_IDLE_MS 2      /* Writer thread sleep when the ring is empty */
+
+#define LOG_ERROR 0 /* Failures */
+#define LOG_WARN 1  /* Stalls and recoverable problems */
+#define LOG_INFO 2  /* Connection and job summaries */
+#define LOG_DEBUG 3 /* Every command sent and every reply received */
+
+int LogStart(int level);                  // Start the writer thread, 0 on success
+void LogStop(void);                       // Drain the ring and stop the writer
+void LogSetLevel(int level);              // Change the level at runtime
+void LogSetOutput(FILE *file);            // Print records here instead of stdout, set before anything is logged
+int LogLevelFromName(const char *name);   // "error", "warn", "info" or "debug", -1 if unknown
+int LogEnabled(int level);                // Whether records at level are kept
+void LogBytes(int level, const char *tag, const void *data, int length); // Raw bytes, formatted by the writer
+void LogPrintf(int level, const char *format, ...);                      // Formatted on the caller's thread
+
+#endif // LOG_H_INCLUDED
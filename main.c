@@ -3,25 +3,43 @@
 #include <string.h>
 #include "rs232.h"
 #include "serial.h"
+#include "status.h"
+#include "capture.h"
+#include "timer.h"
+#include "font.h"
+#include "layout.h"
+#include "generator.h"
+#include "pool.h"
+#include "log.h"
+#include "profile.h"
+#include "trace.h"
+#include "stream.h"
+#include "textpipe.h"
+#include "linecache.h"
+#include "job.h"
 
-#define BAUD_RATE 115200 // Communication baud rate
-#define LINE_WIDTH 100   // Width of each line for text placement
-#define SCALE_MIN 4      // Minimum allowed scaling factor
-#define SCALE_MAX 10     // Maximum allowed scaling factor
-#define LINE_COUNT 1027  // Number of lines in the font data file
-#define CHAR_WIDTH 18.0F // Width of each character in the font
-#define LINE_SPACING -5  // Vertical spacing between lines
+#define BAUD_RATE 115200            // Communication baud rate
+#define SCALE_MIN 4                 // Minimum allowed scaling factor
+#define SCALE_MAX 10                // Maximum allowed scaling factor
+#define GENERATE_BATCH_LINES 4096   // Lines laid out before a parallel generation pass
 
 // Function to send commands to the robot
 void SendCommands(char *buffer);
+void close_connection(void);
 
-// Struct to hold font data for each character
-typedef struct
-{
-    float Xposition;
-    float Yposition;
-    int Zposition;
-} DataEntry;
+FILE *output_file = NULL; // Set by --output, commands go to this file instead of the robot
+int thread_count = 0;     // Set by --threads, 0 uses every core
+int log_level = LOG_INFO; // Set by --log-level
+const char *profile_csv = NULL; // Set by --profile, per-glyph costs are exported here
+const char *stream_file = NULL; // Set by --stream, this G-code file is sent instead of laid out text
+const char *font_file = NULL;   // Set by --font, loaded instead of the font built into the program
+const char *pipe_source = NULL; // Set by --pipe, text is drawn as it arrives on stdin ("-") or a FIFO
+float scale_option = 0;         // Set by --scale, 0 asks for it
+const char *cache_file = NULL;  // Set by --cache, unchanged lines are reused from this file
+LineCache *line_cache = NULL;
+const char *job_file = NULL;  // Set by --compile, the moves are stored in this job file instead of sent
+JobWriter *job_writer = NULL;
+const char *play_file = NULL; // Set by --play, this job file is sent instead of laid out text
 
 // Function to get a valid scaling factor from the user
 float get_scale_factor()
@@ -41,162 +59,498 @@ float get_scale_factor()
     }
 }
 
-// Function to calculate the width of a word
-float calculate_word_width(const char *word, float scaleFactor)
+// Function to open a file and handle errors
+FILE *open_file(const char *filename)
 {
-    return (float)strlen(word) * CHAR_WIDTH * scaleFactor; // Width based on scaled character width
+    FILE *file = fopen(filename, "r");
+    if (!file)
+    {
+        printf("Error opening file: %s\n", filename);
+    }
+    return file;
 }
 
-// Function to check if a word fits in the remaining line space
-int fits_in_line(double *remaining_space, float word_width)
+// Function to emit commands, one line at a time to the robot or all at once to the output file.
+// When profiling, tags give the glyph of each command so its send to ok time can be charged to it.
+void emit_commands(const char *text, size_t length, const unsigned char *tags)
 {
-    if (*remaining_space >= word_width)
+    if (job_writer)
+    {
+        job_writer_add(job_writer, text, length);
+        return;
+    }
+    if (output_file)
     {
-        *remaining_space -= word_width; // Update remaining space
-        return 1;                       // Word fits
+        fwrite(text, 1, length, output_file);
+        return;
+    }
+
+    char buffer[256];
+    const char *end = text + length;
+    for (int command = 0; text < end; command++)
+    {
+        const char *newline = memchr(text, '\n', end - text);
+        size_t line = newline ? (size_t)(newline - text) + 1 : (size_t)(end - text);
+        if (line >= sizeof(buffer))
+            line = sizeof(buffer) - 1;
+        memcpy(buffer, text, line);
+        buffer[line] = 0;
+
+        long long sent = tags ? TimerMicros() : 0;
+        long long span = TraceBegin();
+        SendCommands(buffer);
+        TraceEnd("serial", "send", span, buffer, (int)line);
+        if (tags)
+            profile_record_ack(tags[command], (TimerMicros() - sent) / 1e6);
+        text += line;
     }
-    return 0; // Word doesn't fit
 }
 
-// Function to open a file and handle errors
-FILE *open_file(const char *filename)
+// Function to send the commands a job file is played back as
+void play_commands(const char *text, size_t length)
 {
-    FILE *file = fopen(filename, "r");
-    if (!file)
+    emit_commands(text, length, NULL);
+}
+
+// Function to generate the completed lines of a document in parallel and emit them in order
+void emit_lines(const Document *document, int line_count, const Font *font, ThreadPool *pool,
+                CommandBlock **blocks, int *block_capacity, size_t *total_bytes)
+{
+    if (line_count > *block_capacity)
     {
-        printf("Error opening file: %s\n", filename);
+        *blocks = realloc(*blocks, line_count * sizeof(CommandBlock));
+        if (!*blocks)
+        {
+            printf("Out of memory during generation\n");
+            exit(1);
+        }
+        for (int i = *block_capacity; i < line_count; i++)
+            block_init(&(*blocks)[i]);
+        *block_capacity = line_count;
+    }
+
+    long long span = TraceBegin();
+    if (line_cache)
+        line_cache_generate(line_cache, document, line_count, font, *blocks, pool);
+    else
+        generate_lines(document, line_count, font, *blocks, pool);
+    TraceEnd("generate", "generate batch", span, NULL, 0);
+
+    for (int i = 0; i < line_count; i++)
+    {
+        emit_commands((*blocks)[i].text ? (*blocks)[i].text : "", (*blocks)[i].length,
+                      profile_enabled ? (*blocks)[i].tags : NULL);
+        *total_bytes += (*blocks)[i].length;
     }
-    return file;
 }
 
-// Function to find the stroke data for a specific character
-DataEntry *find_character_data(char character, DataEntry *fontData, int *stroke_count)
+// Function to lay out the input and generate it in batches of lines.
+// Layout is sequential, but every completed line is generated independently on the pool.
+void process_text(FILE *inputFile, const Font *font, float scaleFactor)
 {
-    int ascii_val = (int)character; // Get ASCII value of the character
-    for (int i = 0; i < LINE_COUNT; i++)
+    Document document;
+    CommandBlock *blocks = NULL;
+    int block_capacity = 0, lines = 0;
+    size_t total_bytes = 0;
+    long long started = TimerMicros();
+
+    int threads = thread_count > 0 ? thread_count : pool_default_threads();
+    ThreadPool *pool = threads > 1 ? pool_create(threads) : NULL;
+
+    document_init(&document, scaleFactor);
+
+    // Process each word from the input file
+    char word[100];
+    long long line_span = TraceBegin();
+    while (fscanf(inputFile, "%99s", word) != EOF)
     {
-        if (fontData[i].Xposition == 999 && fontData[i].Yposition == ascii_val)
+        if (layout_word(&document, word))
+        {
+            TraceEnd("layout", "layout line", line_span, NULL, 0);
+            line_span = TraceBegin();
+        }
+        if (document.line_count > GENERATE_BATCH_LINES)
         {
-            *stroke_count = fontData[i].Zposition; // Get stroke count
-            return &fontData[i + 1];               // Return pointer to the first stroke data
+            lines += document.line_count - 1;
+            emit_lines(&document, document.line_count - 1, font, pool, &blocks, &block_capacity, &total_bytes);
+            document_keep_open_line(&document); // Everything but the line still being filled
         }
     }
-    return NULL; // Character data not found
+    TraceEnd("layout", "layout line", line_span, NULL, 0);
+    lines += document.line_count;
+    emit_lines(&document, document.line_count, font, pool, &blocks, &block_capacity, &total_bytes);
+
+    double seconds = (TimerMicros() - started) / 1e6;
+    printf("Generated %d lines, %zu bytes in %.3f s on %d thread%s\n", lines, total_bytes, seconds,
+           pool ? threads : 1, pool ? "s" : "");
+
+    for (int i = 0; i < block_capacity; i++)
+        block_free(&blocks[i]);
+    free(blocks);
+    pool_destroy(pool);
+    document_free(&document);
 }
 
-// Function to generate G-code commands for a word
-void generate_gcode_for_word(const char *word, DataEntry *fontData, float scaleFactor, float *current_Xpos, float current_Ypos)
+// Function to draw text as it arrives. Each laid-out line is generated and sent as soon as it
+// is complete, so the first strokes do not wait for the rest of the text. A line the writer
+// ends, or one left partly filled when the input goes quiet, is drawn right away and the
+// text continues on the next line. Only the open line is kept in memory.
+void process_pipe(TextPipe *input, const Font *font, float scaleFactor)
 {
-    char buffer[4000] = ""; // Buffer for G-code commands
-    for (int i = 0; word[i]; i++)
-    { // Process each character in the word
-        int stroke_count;
-        DataEntry *charData = find_character_data(word[i], fontData, &stroke_count);
-        if (charData)
-        {
-            for (int j = 0; j < stroke_count; j++)
-            { // Generate G-code for each stroke
-                float scaledX = (charData[j].Xposition * scaleFactor) + *current_Xpos;
-                float scaledY = (charData[j].Yposition * scaleFactor) + current_Ypos;
-                sprintf(buffer, "S%d\nG%c X%.2f Y%.2f\n",
-                        charData[j].Zposition ? 1000 : 0,  // Pen state
-                        charData[j].Zposition ? '1' : '0', // Move type
-                        scaledX, scaledY);
-                SendCommands(buffer); // Send G-code command
+    Document document;
+    CommandBlock *blocks = NULL;
+    int block_capacity = 0, lines = 0;
+    size_t total_bytes = 0;
+    long long started = TimerMicros(), first_line = 0;
+    PipeEvent event;
+
+    document_init(&document, scaleFactor);
+
+    while ((event = text_pipe_next(input, PIPE_IDLE_MS)) != PIPE_END)
+    {
+        int complete = event == PIPE_WORD ? layout_word(&document, input->word) : document_break_line(&document);
+        if (!complete)
+            continue;
+
+        emit_lines(&document, 1, font, NULL, &blocks, &block_capacity, &total_bytes);
+        document_keep_open_line(&document);
+        if (output_file)
+            fflush(output_file);
+        if (!lines++)
+            first_line = TimerMicros();
+    }
+    if (document.lines[0].word_count)
+    {
+        emit_lines(&document, 1, font, NULL, &blocks, &block_capacity, &total_bytes);
+        lines++;
+    }
+
+    double seconds = (TimerMicros() - started) / 1e6;
+    printf("Drew %d lines, %zu bytes in %.3f s", lines, total_bytes, seconds);
+    if (first_line)
+        printf(", first line after %.3f s", (first_line - started) / 1e6);
+    printf("\n");
+
+    for (int i = 0; i < block_capacity; i++)
+        block_free(&blocks[i]);
+    free(blocks);
+    document_free(&document);
+}
+
+// Function to read command line options
+int parse_arguments(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--device") && i + 1 < argc)
+        {
+            if (SetSerialDevice(argv[++i]))
+            {
+                printf("Invalid device name: %s\n", argv[i]);
+                return -1;
+            }
+        }
+        else if (!strcmp(argv[i], "--baud-cache") && i + 1 < argc)
+        {
+            if (SetBaudCacheFile(argv[++i]))
+            {
+                printf("Invalid file name: %s\n", argv[i]);
+                return -1;
+            }
+        }
+        else if (!strcmp(argv[i], "--transport") && i + 1 < argc)
+        {
+            if (SelectTransport(argv[++i]))
+            {
+                printf("Unknown transport: %s (serial, tcp, file, null or console)\n", argv[i]);
+                return -1;
+            }
+        }
+        else if (!strcmp(argv[i], "--rtscts"))
+        {
+            SetHardwareFlow(1);
+        }
+        else if (!strcmp(argv[i], "--dialect") && i + 1 < argc)
+        {
+            int dialect = dialect_from_name(argv[++i]);
+            if (dialect < 0)
+            {
+                printf("Unknown dialect: %s (gcode or hpgl)\n", argv[i]);
+                return -1;
+            }
+            output_dialect = (Dialect)dialect;
+        }
+        else if (!strcmp(argv[i], "--checksum"))
+        {
+            SetLineNumbers(1);
+        }
+        else if (!strcmp(argv[i], "--capture") && i + 1 < argc)
+        {
+            if (StartCapture(argv[++i]))
+                return -1;
+            atexit(StopCapture); // Flush the trace however the run ends
+        }
+        else if ((!strcmp(argv[i], "--output") || !strcmp(argv[i], "-o")) && i + 1 < argc)
+        {
+            output_file = fopen(argv[++i], "w");
+            if (!output_file)
+            {
+                printf("Unable to create output file: %s\n", argv[i]);
+                return -1;
+            }
+        }
+        else if (!strcmp(argv[i], "--threads") && i + 1 < argc)
+        {
+            thread_count = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--profile") && i + 1 < argc)
+        {
+            profile_csv = argv[++i];
+            profile_enabled = 1;
+        }
+        else if (!strcmp(argv[i], "--stream") && i + 1 < argc)
+        {
+            stream_file = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--compile") && i + 1 < argc)
+        {
+            job_file = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--play") && i + 1 < argc)
+        {
+            play_file = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--pipe") && i + 1 < argc)
+        {
+            pipe_source = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--scale") && i + 1 < argc)
+        {
+            scale_option = (float)atof(argv[++i]);
+            if (scale_option < SCALE_MIN || scale_option > SCALE_MAX)
+            {
+                printf("The scaling factor must be between %d and %d\n", SCALE_MIN, SCALE_MAX);
+                return -1;
+            }
+        }
+        else if (!strcmp(argv[i], "--cache") && i + 1 < argc)
+        {
+            cache_file = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--font") && i + 1 < argc)
+        {
+            font_file = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--trace") && i + 1 < argc)
+        {
+            if (TraceStart(argv[++i]))
+                return -1;
+            atexit(TraceFlush); // Events stay in memory until the job is over
+        }
+        else if (!strcmp(argv[i], "--trace-words"))
+        {
+            TraceDetail(1); // A span per word fills the buffer quickly on a long document
+        }
+        else if (!strcmp(argv[i], "--log-level") && i + 1 < argc)
+        {
+            log_level = LogLevelFromName(argv[++i]);
+            if (log_level < 0)
+            {
+                printf("Unknown log level: %s (error, warn, info or debug)\n", argv[i]);
+                return -1;
             }
         }
         else
         {
-            printf("Character '%c' - Stroke data not found.\n", word[i]);
+            printf("Unknown option: %s\n", argv[i]);
+            printf("Usage: %s [--transport <serial|tcp|file|null|console>] [--device <path|host:port|file>]\n"
+                   "          [--rtscts] [--checksum] [--capture <trace file>] [--output <gcode file>]\n"
+                   "          [--threads <n>] [--log-level <error|warn|info|debug>] [--profile <csv file>]\n"
+                   "          [--trace <json file>] [--trace-words] [--stream <gcode file>] [--font <font file>]\n"
+                   "          [--scale <n>] [--pipe <fifo|->] [--cache <file>] [--dialect <gcode|hpgl>]\n"
+                   "          [--compile <job file>] [--play <job file>] [--baud-cache <file>]\n",
+                   argv[0]);
+            return -1;
         }
-        *current_Xpos += CHAR_WIDTH * scaleFactor; // Advance to next character position
     }
+    if (job_file && (output_file || stream_file || play_file))
+    {
+        printf("--compile writes a job file, it cannot be combined with --output, --stream or --play\n");
+        return -1;
+    }
+    if (job_file && output_dialect != DIALECT_GCODE)
+    {
+        printf("A job file stores moves, not a dialect, give --dialect when it is played\n");
+        return -1;
+    }
+    if (output_dialect == DIALECT_HPGL && !output_file &&
+        (!strcmp(TransportName(), "serial") || !strcmp(TransportName(), "tcp")))
+    {
+        printf("The %s transport talks to a Grbl controller, write HP-GL with --output or the file transport\n",
+               TransportName());
+        return -1;
+    }
+    if (pipe_source && !strcmp(pipe_source, "-") && !scale_option)
+    {
+        printf("--pipe - reads the text from stdin, give the scaling factor with --scale\n");
+        return -1;
+    }
+    return 0;
 }
 
-// Function to reset position for a new line
-void reset_position(float *current_Xpos, float *current_Ypos, float scaleFactor, double *remaining_space)
+int main(int argc, char *argv[])
 {
-    *current_Xpos = 0;                                        // Reset X-position
-    *current_Ypos += LINE_SPACING - CHAR_WIDTH * scaleFactor; // Move to the next line
-    *remaining_space = LINE_WIDTH;                            // Reset remaining space for the new line
-    char buffer[100];
-    sprintf(buffer, "G0 X%.2f Y%.2f\n", *current_Xpos, *current_Ypos);
-    SendCommands(buffer); // Send command to move to the new line
-}
+    if (parse_arguments(argc, argv))
+        return 1;
 
-int main()
-{
-    if (CanRS232PortBeOpened() == -1)
+    LogStart(log_level);
+    atexit(LogStop); // Drain pending records however the run ends
+
+    if (!output_file && !job_file)
     {
-        printf("Unable to open the COM port (specified in serial.h).\n");
-        return 1;
+        if (CanRS232PortBeOpened() == -1)
+        {
+            printf("Unable to open the %s transport (the COM port is specified in serial.h).\n", TransportName());
+            return 1;
+        }
+
+        printf("Initializing robot...\n");
+        if (ConnectController())
+        {
+            printf("The robot did not answer the reset, check that it is powered and connected.\n");
+            CloseRS232Port();
+            return 1;
+        }
+        printf("Robot ready to draw.\n");
+        StartStatusPoller(); // Track machine state and buffer fill in the background
     }
 
-    printf("Initializing robot...\n");
-    SendCommands("\n"); // Wake up robot
-    PrintBuffer("\n");
-    Sleep(100);
-    WaitForDollar(); // Wait for the robot to signal readiness
-    printf("Robot ready to draw.\n");
+    // An existing G-code file is sent as it is
+    if (stream_file)
+    {
+        int result = stream_gcode_file(stream_file, output_file);
+        if (output_file)
+            fclose(output_file);
+        else
+            close_connection();
+        return result ? 1 : 0;
+    }
 
-    // Set initial robot state
-    SendCommands("G1 X0 Y0 F1000\n");
-    SendCommands("M3\n");
-    SendCommands("S0\n");
+    // A compiled job is serialized in the output dialect as it is sent
+    if (play_file)
+    {
+        char buffer[100];
+        emit_commands(buffer, format_job_start(buffer), NULL);
+        int result = job_play(play_file, play_commands);
+        emit_commands(buffer, format_job_end(buffer), NULL);
+        if (output_file)
+            fclose(output_file);
+        else
+            close_connection();
+        return result ? 1 : 0;
+    }
 
-    // Load font data
-    FILE *fontFile = open_file("SingleStrokeFont.txt");
-    if (!fontFile)
+    // The moves are stored rather than sent, the player adds the start and end of the job
+    if (job_file && !(job_writer = job_writer_open(job_file)))
         return 1;
 
-    DataEntry fontData[LINE_COUNT];
-    for (int i = 0; i < LINE_COUNT; i++)
+    // Set initial robot state
+    char buffer[100];
+    if (!job_writer)
+        emit_commands(buffer, format_job_start(buffer), NULL);
+
+    // The font is built in, unless another one was asked for
+    const Font *font = &embedded_font;
+    if (font_file)
     {
-        fscanf(fontFile, "%f %f %d", &fontData[i].Xposition, &fontData[i].Yposition, &fontData[i].Zposition);
+        static DataEntry fontData[LINE_COUNT];
+        static Font loaded_font;
+        long long span = TraceBegin();
+        if (load_font(font_file, fontData))
+            return 1;
+        index_font(&loaded_font, fontData);
+        font = &loaded_font;
+        TraceEnd("font", "load font", span, font_file, -1);
     }
-    fclose(fontFile);
 
     // Get scale factor from user
-    float scaleFactor = get_scale_factor();
+    float scaleFactor = scale_option ? scale_option / CHAR_WIDTH : get_scale_factor();
     printf("Scale factor: %f\n", scaleFactor);
 
-    // Open input file for text
-    char inputFilename[200];
-    printf("Enter the name of the text file: ");
-    scanf("%199s", inputFilename);
-    FILE *inputFile = open_file(inputFilename);
-    if (!inputFile)
+    // Lines generated by an earlier run are reused, the profile needs every line generated
+    if (cache_file && profile_enabled)
+        printf("The line cache is not used while profiling\n");
+    else if (cache_file && !(line_cache = line_cache_open(cache_file, font, scaleFactor)))
         return 1;
 
-    // Initialize positions and space tracker
-    double remaining_space = LINE_WIDTH;
-    float current_Xpos = 0, current_Ypos = LINE_SPACING - CHAR_WIDTH * scaleFactor;
-
-    // Process each word from the input file
-    char word[100];
-    while (fscanf(inputFile, "%99s", word) != EOF)
+    if (pipe_source)
     {
-        float wordWidth = calculate_word_width(word, scaleFactor);
-        if (!fits_in_line(&remaining_space, wordWidth))
-        {
-            reset_position(&current_Xpos, &current_Ypos, scaleFactor, &remaining_space); // New line
-        }
-        generate_gcode_for_word(word, fontData, scaleFactor, &current_Xpos, current_Ypos); // G-code for word
-        current_Xpos += CHAR_WIDTH * scaleFactor;                                          // Space after the word
-        remaining_space -= CHAR_WIDTH * scaleFactor;
+        // Text is drawn as it arrives
+        TextPipe input;
+        if (text_pipe_open(&input, pipe_source))
+            return 1;
+        process_pipe(&input, font, scaleFactor);
+        text_pipe_close(&input);
     }
+    else
+    {
+        // Open input file for text
+        char inputFilename[200];
+        printf("Enter the name of the text file: ");
+        scanf("%199s", inputFilename);
+        FILE *inputFile = open_file(inputFilename);
+        if (!inputFile)
+            return 1;
+
+        process_text(inputFile, font, scaleFactor);
+        fclose(inputFile);
+    }
+    if (line_cache)
+        line_cache_close(line_cache);
 
     // Finish by returning to the origin
-    SendCommands("G1 X0 Y0\n");
+    if (!job_writer)
+        emit_commands(buffer, format_job_end(buffer), NULL);
+
+    if (profile_enabled)
+    {
+        profile_print(stdout);
+        if (!profile_write_csv(profile_csv))
+            printf("Per-glyph costs written to %s\n", profile_csv);
+    }
+
+    if (job_writer)
+        return job_writer_close(job_writer) ? 1 : 0;
+
+    if (output_file)
+    {
+        fclose(output_file);
+        printf("Commands written to the output file.\n");
+        return 0;
+    }
+
+    close_connection();
+    return 0;
+}
+
+// Function to stop tracking the robot and close the port
+void close_connection(void)
+{
+    StatusSnapshot status;
+    StopStatusPoller();
+    if (ReadStatusSnapshot(&status))
+    {
+        printf("Controller %s at X%.2f Y%.2f after %lu status reports\n",
+               MachineStateName(status.state), status.x, status.y, status.reports);
+    }
+
     CloseRS232Port();
     printf("COM port closed.\n");
-    return 0;
 }
 
 // Function to send commands to the robot
 void SendCommands(char *buffer)
 {
     PrintBuffer(&buffer[0]); // Send buffer to robot
-    WaitForReply();          // Wait for robot acknowledgment
-    Sleep(100);              // Pause briefly
+    WaitForReply();          // Wait for robot acknowledgment, pen settling is a G4 dwell in the stream
 }
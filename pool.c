@@ -0,0 +1,211 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "pool.h"
+
+#if defined(__linux__) || defined(__FreeBSD__)
+#include <unistd.h>
+#else
+#include <windows.h>
+#endif
+
+// Each worker owns a range of task indices. It takes tasks from the front of its own range
+// and, once that is empty, steals the back half of another worker's range. Ranges are only
+// touched under their own small lock, so contention stays on the rare steal.
+typedef struct
+{
+    pthread_mutex_t lock;
+    int head, tail; // Tasks [head, tail) are still to be run
+    char padding[64]; // Keep neighbouring ranges off the same cache line
+} WorkRange;
+
+typedef struct
+{
+    ThreadPool *pool;
+    int index;
+} WorkerArgs;
+
+struct ThreadPool
+{
+    int thread_count;
+    pthread_t *threads;
+    WorkerArgs *args;
+    WorkRange *ranges;
+
+    pthread_mutex_t lock;
+    pthread_cond_t start, done;
+    int generation; // Bumped for every pool_run
+    int busy;       // Workers still running the current generation
+    int stopping;
+
+    PoolTask task;
+    void *context;
+};
+
+int pool_default_threads(void)
+{
+#if defined(__linux__) || defined(__FreeBSD__)
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+#else
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+#endif
+}
+
+// Function to take the next task from a worker's own range, -1 if it is empty
+static int take_own(WorkRange *range)
+{
+    int index = -1;
+
+    pthread_mutex_lock(&range->lock);
+    if (range->head < range->tail)
+        index = range->head++;
+    pthread_mutex_unlock(&range->lock);
+    return index;
+}
+
+// Function to move the back half of another worker's range into our own, returns one task of it or -1
+static int steal(ThreadPool *pool, int self)
+{
+    for (int i = 1; i < pool->thread_count; i++)
+    {
+        WorkRange *victim = &pool->ranges[(self + i) % pool->thread_count];
+        int first = 0, last = 0;
+
+        pthread_mutex_lock(&victim->lock);
+        int remaining = victim->tail - victim->head;
+        if (remaining > 0)
+        {
+            last = victim->tail;
+            first = last - (remaining + 1) / 2;
+            victim->tail = first;
+        }
+        pthread_mutex_unlock(&victim->lock);
+
+        if (last > first)
+        {
+            WorkRange *own = &pool->ranges[self];
+            pthread_mutex_lock(&own->lock);
+            own->head = first + 1;
+            own->tail = last;
+            pthread_mutex_unlock(&own->lock);
+            return first;
+        }
+    }
+    return -1;
+}
+
+static void *worker_main(void *argument)
+{
+    WorkerArgs *args = argument;
+    ThreadPool *pool = args->pool;
+    int seen = 0;
+
+    while (1)
+    {
+        pthread_mutex_lock(&pool->lock);
+        while (pool->generation == seen && !pool->stopping)
+            pthread_cond_wait(&pool->start, &pool->lock);
+        if (pool->stopping)
+        {
+            pthread_mutex_unlock(&pool->lock);
+            return NULL;
+        }
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        int index;
+        while ((index = take_own(&pool->ranges[args->index])) >= 0 || (index = steal(pool, args->index)) >= 0)
+            pool->task(index, pool->context);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->busy == 0)
+            pthread_cond_signal(&pool->done);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+ThreadPool *pool_create(int thread_count)
+{
+    ThreadPool *pool = calloc(1, sizeof(ThreadPool));
+    if (!pool)
+        return NULL;
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    pool->thread_count = thread_count > 0 ? thread_count : 1;
+    pool->threads = calloc(pool->thread_count, sizeof(pthread_t));
+    pool->args = calloc(pool->thread_count, sizeof(WorkerArgs));
+    pool->ranges = calloc(pool->thread_count, sizeof(WorkRange));
+    if (!pool->threads || !pool->args || !pool->ranges)
+    {
+        pool->thread_count = 0;
+        pool_destroy(pool);
+        return NULL;
+    }
+
+    for (int i = 0; i < pool->thread_count; i++)
+    {
+        pthread_mutex_init(&pool->ranges[i].lock, NULL);
+        pool->args[i].pool = pool;
+        pool->args[i].index = i;
+        if (pthread_create(&pool->threads[i], NULL, worker_main, &pool->args[i]))
+        {
+            printf("Unable to start worker thread %d\n", i);
+            pool->thread_count = i; // Only join the ones that started
+            pool_destroy(pool);
+            return NULL;
+        }
+    }
+    return pool;
+}
+
+// Function to run task for every index in [0, task_count) and wait until all are done
+void pool_run(ThreadPool *pool, int task_count, PoolTask task, void *context)
+{
+    if (task_count <= 0)
+        return;
+
+    // Split the indices evenly, stealing evens out tasks of different cost
+    for (int i = 0; i < pool->thread_count; i++)
+    {
+        pthread_mutex_lock(&pool->ranges[i].lock);
+        pool->ranges[i].head = (int)((long long)task_count * i / pool->thread_count);
+        pool->ranges[i].tail = (int)((long long)task_count * (i + 1) / pool->thread_count);
+        pthread_mutex_unlock(&pool->ranges[i].lock);
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->task = task;
+    pool->context = context;
+    pool->busy = pool->thread_count;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start);
+    while (pool->busy > 0)
+        pthread_cond_wait(&pool->done, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void pool_destroy(ThreadPool *pool)
+{
+    if (!pool)
+        return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = 1;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->thread_count; i++)
+        pthread_join(pool->threads[i], NULL);
+
+    free(pool->threads);
+    free(pool->args);
+    free(pool->ranges);
+    free(pool);
+}
@@ -0,0 +1,13 @@
+#ifndef POOL_H_INCLUDED
+#define POOL_H_INCLUDED
+
+typedef void (*PoolTask)(int index, void *context);
+
+typedef struct ThreadPool ThreadPool;
+
+int pool_default_threads(void);                // Number of online cores
+ThreadPool *pool_create(int thread_count);     // Start the worker threads, NULL on failure
+void pool_run(ThreadPool *pool, int task_count, PoolTask task, void *context); // Run task(0..count-1) and wait
+void pool_destroy(ThreadPool *pool);           // Stop and join the workers
+
+#endif // POOL_H_INCLUDED
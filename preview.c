@@ -0,0 +1,485 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "generator.h"
+#include "timer.h"
+
+#define PREVIEW_RESOLUTION 10.0 // Default PNG pixels per mm
+#define PREVIEW_MARGIN 2.0F     // mm of blank page around the drawing
+#define PREVIEW_MAX_PIXELS 16384 // Longest PNG side, the resolution is lowered to fit
+#define PNG_STORED_BLOCK 65535  // Largest uncompressed deflate block
+
+// Renders a command file written with --output (G-code or HP-GL) to SVG and PNG, so a
+// layout can be checked without a robot. Drawn strokes are black, pen-up travel can be
+// overlaid in red. The PNG is stored uncompressed, which keeps it dependency free and fast.
+
+typedef struct
+{
+    float x0, y0, x1, y1;
+    int pen_down;
+} Segment;
+
+typedef struct
+{
+    Segment *segments;
+    long count, capacity;
+    long strokes, travels;
+    float x, y;
+    int pen_down;
+    float min_x, min_y, max_x, max_y;
+} Drawing;
+
+// A pen-down move that goes nowhere is a dot, as on an i or a full stop, and is kept
+static void add_segment(Drawing *drawing, float x, float y)
+{
+    if (x == drawing->x && y == drawing->y && !drawing->pen_down)
+        return;
+
+    if (drawing->count == drawing->capacity)
+    {
+        drawing->capacity = drawing->capacity ? drawing->capacity * 2 : 4096;
+        drawing->segments = realloc(drawing->segments, drawing->capacity * sizeof(Segment));
+        if (!drawing->segments)
+        {
+            printf("Out of memory\n");
+            exit(1);
+        }
+    }
+
+    Segment *segment = &drawing->segments[drawing->count++];
+    segment->x0 = drawing->x;
+    segment->y0 = drawing->y;
+    segment->x1 = x;
+    segment->y1 = y;
+    segment->pen_down = drawing->pen_down;
+    if (drawing->pen_down)
+        drawing->strokes++;
+    else
+        drawing->travels++;
+    drawing->x = x;
+    drawing->y = y;
+}
+
+// One G-code command, the same subset corpus_check follows
+static void parse_gcode(Drawing *drawing, const char *text, const char *end)
+{
+    if (text[0] == 'S')
+        drawing->pen_down = atoi(text + 1) > 0;
+    else if (text[0] == 'G' && (text[1] == '0' || text[1] == '1') && text[2] == ' ')
+    {
+        float x = drawing->x, y = drawing->y;
+
+        for (const char *p = text; p < end; p++)
+        {
+            if (*p == 'X')
+                x = strtof(p + 1, NULL);
+            else if (*p == 'Y')
+                y = strtof(p + 1, NULL);
+        }
+        add_segment(drawing, x, y);
+    }
+}
+
+// One HP-GL instruction, PU and PD point lists in absolute plotter units
+static void parse_hpgl(Drawing *drawing, const char *text, const char *end)
+{
+    if (text[0] != 'P' || (text[1] != 'U' && text[1] != 'D'))
+        return;
+    drawing->pen_down = text[1] == 'D';
+
+    const char *p = text + 2;
+    while (p < end)
+    {
+        char *next;
+        long x = strtol(p, &next, 10);
+
+        if (next == p || *next != ',')
+            break;
+        p = next + 1;
+        long y = strtol(p, &next, 10);
+        if (next == p)
+            break;
+        add_segment(drawing, (float)x / HPGL_UNITS_PER_MM, (float)y / HPGL_UNITS_PER_MM);
+        p = *next == ',' ? next + 1 : next;
+    }
+}
+
+static void parse_commands(Drawing *drawing, const char *text, size_t length)
+{
+    const char *end = text + length;
+
+    while (text < end)
+    {
+        const char *newline = memchr(text, '\n', end - text);
+        const char *line_end = newline ? newline : end;
+
+        if (line_end - text >= 2 && line_end[-1] == ';')
+            parse_hpgl(drawing, text, line_end - 1);
+        else if (line_end - text >= 2)
+            parse_gcode(drawing, text, line_end);
+        text = newline ? newline + 1 : end;
+    }
+}
+
+static void include_point(Drawing *drawing, float x, float y, int first)
+{
+    if (first || x < drawing->min_x)
+        drawing->min_x = x;
+    if (first || x > drawing->max_x)
+        drawing->max_x = x;
+    if (first || y < drawing->min_y)
+        drawing->min_y = y;
+    if (first || y > drawing->max_y)
+        drawing->max_y = y;
+}
+
+// Bounds of what is rendered: the strokes, and the travel when it is shown. HP-GL parks the
+// pen at the plotter origin, well away from the text, which would otherwise fill the page.
+static void measure(Drawing *drawing, int travel)
+{
+    int first = 1;
+
+    for (long i = 0; i < drawing->count; i++)
+    {
+        const Segment *segment = &drawing->segments[i];
+
+        if (!segment->pen_down && !travel)
+            continue;
+        include_point(drawing, segment->x0, segment->y0, first);
+        include_point(drawing, segment->x1, segment->y1, 0);
+        first = 0;
+    }
+}
+
+static int write_svg(const Drawing *drawing, const char *filename, int travel)
+{
+    FILE *file = fopen(filename, "w");
+    float left = drawing->min_x - PREVIEW_MARGIN, top = drawing->max_y + PREVIEW_MARGIN;
+    float width = drawing->max_x - drawing->min_x + 2 * PREVIEW_MARGIN;
+    float height = drawing->max_y - drawing->min_y + 2 * PREVIEW_MARGIN;
+
+    if (!file)
+        return -1;
+
+    // One path per pen state, the robot's Y grows up the page and SVG's grows down
+    fprintf(file,
+            "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%.2fmm\" height=\"%.2fmm\" viewBox=\"0 0 %.2f %.2f\">\n"
+            "<rect width=\"100%%\" height=\"100%%\" fill=\"white\"/>\n",
+            width, height, width, height);
+    for (int pen_down = travel ? 0 : 1; pen_down <= 1; pen_down++)
+    {
+        float x = 0, y = 0;
+        int open = 0;
+
+        if (pen_down)
+            fprintf(file, "<path fill=\"none\" stroke=\"black\" stroke-width=\"0.3\" stroke-linecap=\"round\" "
+                          "stroke-linejoin=\"round\" d=\"");
+        else
+            fprintf(file, "<path fill=\"none\" stroke=\"red\" stroke-width=\"0.15\" stroke-dasharray=\"0.5 0.5\" d=\"");
+
+        for (long i = 0; i < drawing->count; i++)
+        {
+            const Segment *segment = &drawing->segments[i];
+
+            if (segment->pen_down != pen_down)
+                continue;
+            // A dot gets a subpath of its own, its round caps then draw it
+            if (!open || segment->x0 != x || segment->y0 != y ||
+                (segment->x0 == segment->x1 && segment->y0 == segment->y1))
+                fprintf(file, "M%.2f %.2f", segment->x0 - left, top - segment->y0);
+            fprintf(file, "L%.2f %.2f", segment->x1 - left, top - segment->y1);
+            x = segment->x1;
+            y = segment->y1;
+            open = 1;
+        }
+        fprintf(file, "\"/>\n");
+    }
+    fprintf(file, "</svg>\n");
+
+    return fclose(file) ? -1 : 0;
+}
+
+// Two bits per pixel, palette index 0 page, 1 ink, 2 travel
+typedef struct
+{
+    unsigned char *pixels; // Each row starts with its PNG filter byte
+    int width, height, row_bytes;
+} Raster;
+
+static void plot(Raster *raster, int x, int y, int colour)
+{
+    if (x < 0 || y < 0 || x >= raster->width || y >= raster->height)
+        return;
+
+    unsigned char *byte = raster->pixels + (size_t)y * raster->row_bytes + 1 + x / 4;
+    int shift = 6 - 2 * (x % 4);
+    *byte = (unsigned char)((*byte & ~(3 << shift)) | (colour << shift));
+}
+
+// Bresenham, endpoints included
+static void draw_line(Raster *raster, int x0, int y0, int x1, int y1, int colour)
+{
+    int dx = abs(x1 - x0), sx = x0 < x1 ? 1 : -1;
+    int dy = -abs(y1 - y0), sy = y0 < y1 ? 1 : -1;
+    int error = dx + dy;
+
+    while (1)
+    {
+        plot(raster, x0, y0, colour);
+        if (x0 == x1 && y0 == y1)
+            break;
+        int twice = 2 * error;
+        if (twice >= dy)
+        {
+            error += dy;
+            x0 += sx;
+        }
+        if (twice <= dx)
+        {
+            error += dx;
+            y0 += sy;
+        }
+    }
+}
+
+static uint32_t crc_table[256];
+
+static uint32_t png_crc(uint32_t crc, const unsigned char *data, size_t length)
+{
+    if (!crc_table[1])
+    {
+        for (uint32_t n = 0; n < 256; n++)
+        {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++)
+                c = c & 1 ? 0xEDB88320U ^ (c >> 1) : c >> 1;
+            crc_table[n] = c;
+        }
+    }
+
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++)
+        crc = crc_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+static uint32_t adler32(const unsigned char *data, size_t length)
+{
+    uint32_t a = 1, b = 0;
+
+    while (length)
+    {
+        size_t run = length < 5552 ? length : 5552; // Longest run before b can overflow
+        length -= run;
+        while (run--)
+        {
+            a += *data++;
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    return (b << 16) | a;
+}
+
+static void put_u32(unsigned char *out, uint32_t value)
+{
+    out[0] = (unsigned char)(value >> 24);
+    out[1] = (unsigned char)(value >> 16);
+    out[2] = (unsigned char)(value >> 8);
+    out[3] = (unsigned char)value;
+}
+
+static void write_chunk(FILE *file, const char *type, const unsigned char *data, size_t length)
+{
+    unsigned char header[8], trailer[4];
+
+    put_u32(header, (uint32_t)length);
+    memcpy(header + 4, type, 4);
+    put_u32(trailer, png_crc(png_crc(0, header + 4, 4), data, length));
+    fwrite(header, 1, 8, file);
+    fwrite(data, 1, length, file);
+    fwrite(trailer, 1, 4, file);
+}
+
+static int write_png(const Raster *raster, const char *filename)
+{
+    static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    static const unsigned char palette[9] = {255, 255, 255, 0, 0, 0, 220, 40, 40};
+    size_t raw = (size_t)raster->height * raster->row_bytes;
+    size_t blocks = raw / PNG_STORED_BLOCK + 1;
+    unsigned char header[13];
+    unsigned char *zlib = malloc(2 + raw + 5 * blocks + 4), *out = zlib;
+    FILE *file;
+
+    if (!zlib)
+        return -1;
+
+    // zlib stream of stored deflate blocks
+    *out++ = 0x78;
+    *out++ = 0x01;
+    for (size_t offset = 0; offset < raw;)
+    {
+        size_t length = raw - offset < PNG_STORED_BLOCK ? raw - offset : PNG_STORED_BLOCK;
+
+        *out++ = offset + length == raw;
+        *out++ = (unsigned char)length;
+        *out++ = (unsigned char)(length >> 8);
+        *out++ = (unsigned char)~length;
+        *out++ = (unsigned char)(~length >> 8);
+        memcpy(out, raster->pixels + offset, length);
+        out += length;
+        offset += length;
+    }
+    put_u32(out, adler32(raster->pixels, raw));
+    out += 4;
+
+    put_u32(header, (uint32_t)raster->width);
+    put_u32(header + 4, (uint32_t)raster->height);
+    header[8] = 2;  // Bit depth
+    header[9] = 3;  // Indexed colour
+    header[10] = 0; // Deflate
+    header[11] = 0; // Adaptive filtering, every row uses None
+    header[12] = 0; // Not interlaced
+
+    file = fopen(filename, "wb");
+    if (!file)
+    {
+        free(zlib);
+        return -1;
+    }
+    fwrite(signature, 1, sizeof(signature), file);
+    write_chunk(file, "IHDR", header, sizeof(header));
+    write_chunk(file, "PLTE", palette, sizeof(palette));
+    write_chunk(file, "IDAT", zlib, out - zlib);
+    write_chunk(file, "IEND", NULL, 0);
+    free(zlib);
+
+    return fclose(file) ? -1 : 0;
+}
+
+static int render_png(const Drawing *drawing, const char *filename, int travel, double resolution)
+{
+    double width = drawing->max_x - drawing->min_x + 2 * PREVIEW_MARGIN;
+    double height = drawing->max_y - drawing->min_y + 2 * PREVIEW_MARGIN;
+    double longest = width > height ? width : height;
+    Raster raster;
+
+    if (longest * resolution > PREVIEW_MAX_PIXELS)
+    {
+        resolution = PREVIEW_MAX_PIXELS / longest;
+        printf("Page is %.0f mm long, PNG resolution lowered to %.2f px/mm\n", longest, resolution);
+    }
+
+    raster.width = (int)(width * resolution) + 1;
+    raster.height = (int)(height * resolution) + 1;
+    raster.row_bytes = 1 + (raster.width + 3) / 4;
+    raster.pixels = calloc((size_t)raster.height, raster.row_bytes);
+    if (!raster.pixels)
+        return -1;
+
+    // Travel first so ink is drawn over it
+    double left = drawing->min_x - PREVIEW_MARGIN, top = drawing->max_y + PREVIEW_MARGIN;
+    for (int pen_down = travel ? 0 : 1; pen_down <= 1; pen_down++)
+    {
+        for (long i = 0; i < drawing->count; i++)
+        {
+            const Segment *segment = &drawing->segments[i];
+
+            if (segment->pen_down == pen_down)
+                draw_line(&raster, (int)((segment->x0 - left) * resolution + 0.5),
+                          (int)((top - segment->y0) * resolution + 0.5), (int)((segment->x1 - left) * resolution + 0.5),
+                          (int)((top - segment->y1) * resolution + 0.5), pen_down ? 1 : 2);
+        }
+    }
+
+    int result = write_png(&raster, filename);
+    free(raster.pixels);
+    return result;
+}
+
+static char *read_file(const char *filename, size_t *length)
+{
+    FILE *file = fopen(filename, "rb");
+    char *text;
+    long size;
+
+    if (!file)
+        return NULL;
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    text = malloc(size > 0 ? size : 1);
+    if (!text || size < 0 || fread(text, 1, size, file) != (size_t)size)
+    {
+        free(text);
+        fclose(file);
+        return NULL;
+    }
+    fclose(file);
+    *length = size;
+    return text;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *input = NULL, *svg = NULL, *png = NULL;
+    double resolution = PREVIEW_RESOLUTION;
+    int travel = 0, usage = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--svg") && i + 1 < argc)
+            svg = argv[++i];
+        else if (!strcmp(argv[i], "--png") && i + 1 < argc)
+            png = argv[++i];
+        else if (!strcmp(argv[i], "--resolution") && i + 1 < argc)
+            resolution = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--travel"))
+            travel = 1;
+        else if (argv[i][0] != '-' && !input)
+            input = argv[i];
+        else
+            usage = 1;
+    }
+    if (usage || !input || (!svg && !png) || resolution <= 0)
+    {
+        printf("Usage: %s <command file> [--svg <file>] [--png <file>] [--travel] [--resolution <px per mm>]\n",
+               argv[0]);
+        return 1;
+    }
+
+    long long start = TimerMicros();
+    size_t length;
+    char *text = read_file(input, &length);
+    if (!text)
+    {
+        printf("Error opening file: %s\n", input);
+        return 1;
+    }
+
+    Drawing drawing;
+    memset(&drawing, 0, sizeof(drawing));
+    parse_commands(&drawing, text, length);
+    free(text);
+    measure(&drawing, travel);
+
+    if (svg && write_svg(&drawing, svg, travel))
+    {
+        printf("Unable to write %s\n", svg);
+        return 1;
+    }
+    if (png && render_png(&drawing, png, travel, resolution))
+    {
+        printf("Unable to write %s\n", png);
+        return 1;
+    }
+
+    printf("Rendered %ld strokes and %ld travels, %.1f x %.1f mm, in %.1f ms\n", drawing.strokes, drawing.travels,
+           drawing.max_x - drawing.min_x, drawing.max_y - drawing.min_y, (TimerMicros() - start) / 1000.0);
+    free(drawing.segments);
+    return 0;
+}
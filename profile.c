@@ -0,0 +1,143 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "profile.h"
+#include "feed.h"
+#include "generator.h"
+
+int profile_enabled = 0;
+
+static GlyphProfile job_profile;
+static pthread_mutex_t profile_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void profile_merge(const GlyphProfile *partial)
+{
+    pthread_mutex_lock(&profile_lock);
+    for (int i = 0; i < PROFILE_BUCKETS; i++)
+    {
+        const GlyphCost *from = &partial->glyphs[i];
+        GlyphCost *to = &job_profile.glyphs[i];
+        if (!from->commands && !from->occurrences)
+            continue;
+        to->occurrences += from->occurrences;
+        to->commands += from->commands;
+        to->bytes += from->bytes;
+        to->pen_changes += from->pen_changes;
+        to->pen_up_distance += from->pen_up_distance;
+        to->pen_down_distance += from->pen_down_distance;
+    }
+    pthread_mutex_unlock(&profile_lock);
+}
+
+void profile_record_ack(int glyph, double seconds)
+{
+    pthread_mutex_lock(&profile_lock);
+    job_profile.glyphs[glyph & (PROFILE_BUCKETS - 1)].ack_seconds += seconds;
+    job_profile.glyphs[glyph & (PROFILE_BUCKETS - 1)].acked++;
+    pthread_mutex_unlock(&profile_lock);
+}
+
+// Function to estimate drawing time from distances, feeds and pen dwells
+static double estimated_seconds(const GlyphCost *cost)
+{
+    return cost->pen_down_distance * 60.0 / DRAW_FEED + cost->pen_up_distance * 60.0 / TRAVEL_FEED +
+           cost->pen_changes * (PEN_DROP_DWELL + PEN_LIFT_DWELL) / 2;
+}
+
+static int measured; // Rank by ack time when any was recorded, by the estimate otherwise
+
+static double ranking_cost(const GlyphCost *cost)
+{
+    return measured ? cost->ack_seconds : estimated_seconds(cost);
+}
+
+static int compare_cost(const void *a, const void *b)
+{
+    double ca = ranking_cost(&job_profile.glyphs[*(const int *)a]);
+    double cb = ranking_cost(&job_profile.glyphs[*(const int *)b]);
+    return (ca < cb) - (ca > cb);
+}
+
+// Function to list the used buckets, most expensive first, returns how many there are
+static int ranked_glyphs(int *order, double *total)
+{
+    int count = 0;
+
+    measured = 0;
+    *total = 0;
+    for (int i = 0; i < PROFILE_BUCKETS; i++)
+        measured |= job_profile.glyphs[i].acked != 0;
+
+    for (int i = 0; i < PROFILE_BUCKETS; i++)
+    {
+        if (job_profile.glyphs[i].commands || job_profile.glyphs[i].occurrences)
+        {
+            order[count++] = i;
+            *total += ranking_cost(&job_profile.glyphs[i]);
+        }
+    }
+    qsort(order, count, sizeof(int), compare_cost);
+    return count;
+}
+
+static void glyph_label(int glyph, char *label)
+{
+    if (glyph == PROFILE_OTHER)
+        strcpy(label, "(travel)");
+    else if (glyph > 32 && glyph < 127)
+        sprintf(label, "'%c'", glyph);
+    else
+        sprintf(label, "0x%02X", glyph);
+}
+
+void profile_print(FILE *out)
+{
+    int order[PROFILE_BUCKETS];
+    double total;
+    int count = ranked_glyphs(order, &total);
+    char label[16];
+
+    fprintf(out, "\nPer-glyph cost, ranked by %s\n", measured ? "measured ack time" : "estimated draw time");
+    fprintf(out, "%-9s %7s %9s %10s %7s %10s %10s %9s %9s %6s\n", "glyph", "count", "commands", "bytes", "pen", "up mm",
+            "down mm", "est s", "ack s", "share");
+    for (int i = 0; i < count; i++)
+    {
+        const GlyphCost *cost = &job_profile.glyphs[order[i]];
+        glyph_label(order[i], label);
+        fprintf(out, "%-9s %7lu %9lu %10lu %7lu %10.1f %10.1f %9.2f %9.2f %5.1f%%\n", label, cost->occurrences,
+                cost->commands, cost->bytes, cost->pen_changes, cost->pen_up_distance, cost->pen_down_distance,
+                estimated_seconds(cost), cost->ack_seconds, total > 0 ? 100.0 * ranking_cost(cost) / total : 0.0);
+    }
+}
+
+int profile_write_csv(const char *filename)
+{
+    int order[PROFILE_BUCKETS];
+    double total;
+    int count = ranked_glyphs(order, &total);
+    char label[16];
+    FILE *file = fopen(filename, "w");
+
+    if (!file)
+    {
+        printf("Unable to create profile file: %s\n", filename);
+        return -1;
+    }
+
+    fprintf(file, "glyph,code,count,commands,bytes,pen_changes,pen_up_mm,pen_down_mm,estimated_s,ack_s,acked\n");
+    for (int i = 0; i < count; i++)
+    {
+        const GlyphCost *cost = &job_profile.glyphs[order[i]];
+        glyph_label(order[i], label);
+        if (order[i] > 32 && order[i] < 127 && strchr(",\"", order[i]))
+            sprintf(label, "\"%s\"", order[i] == '"' ? "'\"\"'" : "','"); // Quote the CSV separators
+        fprintf(file, "%s,%d,%lu,%lu,%lu,%lu,%.3f,%.3f,%.3f,%.6f,%lu\n", label, order[i], cost->occurrences,
+                cost->commands, cost->bytes, cost->pen_changes, cost->pen_up_distance, cost->pen_down_distance,
+                estimated_seconds(cost), cost->ack_seconds, cost->acked);
+    }
+
+    fclose(file);
+    return 0;
+}
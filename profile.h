@@ -0,0 +1,34 @@
+#include <stdio.h>
+
+#ifndef PROFILE_H_INCLUDED
+#define PROFILE_H_INCLUDED
+
+#define PROFILE_BUCKETS 256 // One per byte value
+#define PROFILE_OTHER 0     // Bucket for commands no glyph produced, such as the travel to a new line
+
+// Cost attributed to one glyph over a whole job
+typedef struct
+{
+    unsigned long occurrences;
+    unsigned long commands;
+    unsigned long bytes;
+    unsigned long pen_changes;
+    double pen_up_distance;   // mm
+    double pen_down_distance; // mm
+    double ack_seconds;       // Measured from send to ok, when connected
+    unsigned long acked;      // Commands that contributed to ack_seconds
+} GlyphCost;
+
+typedef struct
+{
+    GlyphCost glyphs[PROFILE_BUCKETS];
+} GlyphProfile;
+
+extern int profile_enabled; // Set by --profile, generation only attributes costs when it is on
+
+void profile_merge(const GlyphProfile *partial);  // Add a per-line profile into the job total, thread safe
+void profile_record_ack(int glyph, double seconds); // Attribute a measured send to ok time
+void profile_print(FILE *out);                    // Ranked table of the job total
+int profile_write_csv(const char *filename);      // Same table as CSV, 0 on success
+
+#endif // PROFILE_H_INCLUDED
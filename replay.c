@@ -0,0 +1,213 @@
+#define _GNU_SOURCE /* posix_openpt, ptsname and cfmakeraw */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "capture.h"
+#include "timer.h"
+
+#define REPLAY_IDLE_TIMEOUT 10000 /* ms without sender progress before the replay gives up */
+#define REPLAY_TAIL 500           /* ms to keep draining the sender after the last reply */
+
+#if defined(__linux__) || defined(__FreeBSD__)
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+// Plays the controller side of a capture against a live sender through a pseudo terminal.
+//
+// A reply in the trace is tied to the number of complete lines the host had sent when it
+// arrived. During playback the same reply is held back until the live sender has sent as
+// many lines, then released after the recorded reply delay (scaled). The sender sees the
+// controller timing of the original run, whatever it now sends in between.
+
+static int master = -1;
+static long long *line_times; // When each live line was completed
+static long live_lines, line_capacity;
+static long long live_bytes, live_origin;
+
+// Read what the sender wrote within timeout ms, timestamping each completed line
+static void DrainSender(int timeout)
+{
+    unsigned char buf[4096];
+    struct pollfd pfd;
+    long long now;
+    int i, n;
+
+    pfd.fd = master;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+
+    if (poll(&pfd, 1, timeout) <= 0 || !(pfd.revents & POLLIN))
+        return;
+
+    n = (int)read(master, buf, sizeof(buf));
+    if (n <= 0)
+        return;
+
+    now = TimerMicros();
+    if (!live_bytes)
+        live_origin = now;
+    live_bytes += n;
+
+    for (i = 0; i < n; i++)
+    {
+        if (buf[i] != '\n')
+            continue;
+        if (live_lines == line_capacity)
+        {
+            line_capacity = line_capacity ? line_capacity * 2 : 4096;
+            line_times = realloc(line_times, line_capacity * sizeof(*line_times));
+            if (!line_times)
+            {
+                printf("Out of memory\n");
+                exit(1);
+            }
+        }
+        line_times[live_lines++] = now;
+    }
+}
+
+// Open a pty with a raw slave so nothing is echoed back before the sender configures it
+static int OpenLoopback(void)
+{
+    struct termios settings;
+    int slave;
+
+    master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master == -1 || grantpt(master) || unlockpt(master))
+    {
+        perror("unable to create pseudo terminal");
+        return (-1);
+    }
+
+    // Holding the slave open keeps the master readable across sender reconnects
+    slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+    if (slave == -1 || tcgetattr(slave, &settings))
+    {
+        perror("unable to open pseudo terminal");
+        return (-1);
+    }
+    cfmakeraw(&settings);
+    tcsetattr(slave, TCSANOW, &settings);
+
+    return (0);
+}
+
+int main(int argc, char *argv[])
+{
+    CaptureRecord *record;
+    FILE *trace;
+    long long clock = 0, trace_origin = -1, trace_line_time = 0, trace_end = 0;
+    long trace_lines = 0, replies = 0;
+    double scale = 1.0;
+    int i;
+
+    if (argc < 2 || argc > 3)
+    {
+        printf("Usage: %s <trace file> [time scale, 1 = recorded speed, 0 = no delays]\n", argv[0]);
+        return 1;
+    }
+    if (argc == 3)
+        scale = atof(argv[2]);
+
+    trace = fopen(argv[1], "rb");
+    if (!trace || OpenCaptureTrace(trace))
+    {
+        printf("Not a capture trace: %s\n", argv[1]);
+        return 1;
+    }
+
+    record = malloc(sizeof(*record));
+    if (!record || OpenLoopback())
+        return 1;
+
+    printf("Controller replay on %s, run the sender with --device %s\n", ptsname(master), ptsname(master));
+    fflush(stdout);
+
+    while (!live_bytes)
+        DrainSender(100); // The replay clock starts with the sender's first byte
+
+    while (ReadCaptureRecord(trace, record, &clock))
+    {
+        trace_end = record->time;
+
+        if (record->direction == CAPTURE_TX)
+        {
+            if (trace_origin < 0)
+                trace_origin = record->time;
+            for (i = 0; i < record->length; i++)
+            {
+                if (record->data[i] == '\n')
+                {
+                    trace_lines++;
+                    trace_line_time = record->time;
+                }
+            }
+            continue;
+        }
+
+        // Hold the reply until the live sender has caught up with the line that caused it
+        long long waited = TimerMillis();
+        while (live_lines < trace_lines)
+        {
+            DrainSender(100);
+            if (TimerMillis() - waited > REPLAY_IDLE_TIMEOUT)
+            {
+                printf("Sender stopped after %ld of %ld lines, replay diverged\n", live_lines, trace_lines);
+                goto done;
+            }
+        }
+
+        long long trace_base = trace_lines ? trace_line_time : (trace_origin < 0 ? record->time : trace_origin);
+        long long live_base = trace_lines ? line_times[trace_lines - 1] : live_origin;
+        long long target = live_base + (long long)((record->time - trace_base) * scale);
+        long long now;
+
+        while ((now = TimerMicros()) < target)
+            DrainSender((int)((target - now + 999) / 1000));
+
+        if (write(master, record->data, record->length) != record->length)
+        {
+            perror("unable to write reply");
+            break;
+        }
+        replies++;
+    }
+
+    {
+        long long tail = TimerMillis();
+        while (TimerMillis() - tail < REPLAY_TAIL)
+            DrainSender(REPLAY_TAIL);
+    }
+
+done:
+    printf("Replayed %ld replies against %ld of %ld recorded lines (%lld bytes received)\n",
+           replies, live_lines, trace_lines, live_bytes);
+    if (live_lines)
+    {
+        double recorded = (trace_line_time - (trace_origin < 0 ? 0 : trace_origin)) / 1e6;
+        double replayed = (line_times[live_lines - 1] - live_origin) / 1e6;
+        printf("Recorded %.3f s to the last line, replay took %.3f s (%.1f%%), trace ends at %.3f s\n",
+               recorded, replayed, recorded > 0 ? 100.0 * replayed / recorded : 0.0,
+               (trace_end - (trace_origin < 0 ? 0 : trace_origin)) / 1e6);
+    }
+
+    fclose(trace);
+    free(record);
+    free(line_times);
+    return 0;
+}
+
+#else
+
+int main(void)
+{
+    printf("Replay needs pseudo terminals, it is only available on Linux and FreeBSD\n");
+    return 1;
+}
+
+#endif
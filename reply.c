@@ -0,0 +1,117 @@
+#include <string.h>
+
+#include "reply.h"
+
+#define REPLY_MASK (REPLY_RING_SIZE - 1)
+
+void ReplyInit(ReplyParser *parser)
+{
+    parser->head = parser->tail = parser->scanned = 0;
+    parser->dropped = 0;
+}
+
+unsigned char *ReplySpace(ReplyParser *parser, int *size)
+{
+    unsigned used = parser->head - parser->tail;
+
+    // A line longer than the ring can never complete, drop it to make room
+    if (used == REPLY_RING_SIZE)
+    {
+        parser->dropped += used;
+        parser->tail = parser->scanned = parser->head;
+        used = 0;
+    }
+
+    unsigned start = parser->head & REPLY_MASK;
+    unsigned free = REPLY_RING_SIZE - used;
+    unsigned contiguous = REPLY_RING_SIZE - start;
+
+    *size = (int)(free < contiguous ? free : contiguous);
+    return parser->data + start;
+}
+
+void ReplyCommit(ReplyParser *parser, int length)
+{
+    if (length > 0)
+        parser->head += length;
+}
+
+// N of error:N, ALARM:N or Resend: N, the number after the first separator
+static int ReplyCode(const char *text, int length, char separator)
+{
+    const char *mark = memchr(text, separator, length);
+    int code = 0, i;
+
+    if (!mark)
+        return -1;
+    for (i = (int)(mark - text) + 1; i < length && text[i] == ' '; i++)
+        ;
+    for (; i < length && text[i] >= '0' && text[i] <= '9'; i++)
+        code = code * 10 + text[i] - '0';
+    return code;
+}
+
+static ReplyKind ReplyClassify(const char *text, int length, int *code)
+{
+    *code = -1;
+    if (length >= 2 && text[0] == 'o' && text[1] == 'k')
+        return REPLY_OK;
+    if (length && text[0] == '<')
+        return REPLY_STATUS;
+    if (length >= 5 && !memcmp(text, "error", 5))
+    {
+        *code = ReplyCode(text, length, ':');
+        return REPLY_ERROR;
+    }
+    if (length >= 5 && !memcmp(text, "ALARM", 5))
+    {
+        *code = ReplyCode(text, length, ':');
+        return REPLY_ALARM;
+    }
+    if (length >= 5 && !memcmp(text, "Grbl ", 5))
+        return REPLY_BANNER;
+    if ((length >= 7 && !memcmp(text, "Resend:", 7)) || (length >= 3 && !memcmp(text, "rs ", 3)))
+    {
+        *code = ReplyCode(text, length, text[0] == 'R' ? ':' : ' ');
+        return REPLY_RESEND;
+    }
+    return REPLY_OTHER;
+}
+
+int ReplyNext(ReplyParser *parser, ReplyLine *line)
+{
+    unsigned end;
+
+    for (end = parser->scanned; end != parser->head; end++)
+    {
+        if (parser->data[end & REPLY_MASK] == '\n')
+            break;
+    }
+    if (end == parser->head)
+    {
+        parser->scanned = end;
+        return 0;
+    }
+
+    unsigned start = parser->tail & REPLY_MASK;
+    int length = (int)(end - parser->tail);
+
+    if (start + length <= REPLY_RING_SIZE)
+        line->text = (const char *)parser->data + start;
+    else
+    {
+        // The line wraps around the end of the ring
+        int first = REPLY_RING_SIZE - start;
+        memcpy(parser->wrapped, parser->data + start, first);
+        memcpy(parser->wrapped + first, parser->data, length - first);
+        line->text = parser->wrapped;
+    }
+
+    while (length && line->text[length - 1] == '\r')
+        length--;
+    line->length = length;
+    line->kind = ReplyClassify(line->text, length, &line->code);
+
+    parser->tail = parser->scanned = end + 1;
+    return 1;
+}
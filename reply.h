@@ -0,0 +1,43 @@
+#ifndef REPLY_H_INCLUDED
+#define REPLY_H_INCLUDED
+
+#define REPLY_RING_SIZE 4096 /* Received bytes held while a line completes, a power of two */
+
+typedef enum
+{
+    REPLY_OK,
+    REPLY_ERROR,  // error:N, the command was rejected
+    REPLY_ALARM,  // ALARM:N, the controller stopped
+    REPLY_STATUS, // <...> status report
+    REPLY_BANNER, // Grbl x.y ['$' for help], the controller (re)started
+    REPLY_RESEND, // Resend: N or rs N, numbered line N arrived damaged
+    REPLY_OTHER   // Messages, settings and blank lines
+} ReplyKind;
+
+// One complete line from the controller
+typedef struct
+{
+    ReplyKind kind;
+    int code;         // N of error:N, ALARM:N or Resend:N, -1 otherwise
+    const char *text; // Without the line end and not NUL-terminated, valid until the next ReplySpace
+    int length;
+} ReplyLine;
+
+// Splits the received stream into lines. The port reads straight into the ring and
+// lines are handed out in place, only a line that wraps around the end is copied.
+typedef struct
+{
+    unsigned char data[REPLY_RING_SIZE];
+    unsigned head;    // Total bytes received
+    unsigned tail;    // Start of the line being received
+    unsigned scanned; // Bytes of that line already searched for a line end
+    char wrapped[REPLY_RING_SIZE];
+    unsigned long dropped; // Bytes of over-long lines thrown away
+} ReplyParser;
+
+void ReplyInit(ReplyParser *parser);
+unsigned char *ReplySpace(ReplyParser *parser, int *size); // Where to read the next bytes, and how many fit
+void ReplyCommit(ReplyParser *parser, int length);          // Bytes that were read into the space
+int ReplyNext(ReplyParser *parser, ReplyLine *line);       // 1 and the next complete line, 0 if there is none
+
+#endif // REPLY_H_INCLUDED
@@ -29,18 +29,14 @@
 
 /* For more info and how to use this library, visit: http://www.teuniz.net/RS-232/ */
 
+#include <stdlib.h>
+
 #include "rs232.h"
 
 #if defined(__linux__) || defined(__FreeBSD__) /* Linux & FreeBSD */
 
 #define RS232_PORTNR 38
 
-int Cport[RS232_PORTNR],
-    error;
-
-struct termios new_port_settings,
-    old_port_settings[RS232_PORTNR];
-
 char *comports[RS232_PORTNR] = {"/dev/ttyS0", "/dev/ttyS1", "/dev/ttyS2", "/dev/ttyS3", "/dev/ttyS4", "/dev/ttyS5",
                                 "/dev/ttyS6", "/dev/ttyS7", "/dev/ttyS8", "/dev/ttyS9", "/dev/ttyS10", "/dev/ttyS11",
                                 "/dev/ttyS12", "/dev/ttyS13", "/dev/ttyS14", "/dev/ttyS15", "/dev/ttyUSB0",
@@ -50,113 +46,138 @@ char *comports[RS232_PORTNR] = {"/dev/ttyS0", "/dev/ttyS1", "/dev/ttyS2", "/dev/
                                 "/dev/cuau0", "/dev/cuau1", "/dev/cuau2", "/dev/cuau3",
                                 "/dev/cuaU0", "/dev/cuaU1", "/dev/cuaU2", "/dev/cuaU3"};
 
-int RS232_OpenComport(int comport_number, int baudrate, const char *mode)
+/* translate a numeric baudrate into its termios speed constant, -1 if unsupported */
+static int RS232_BaudConstant(int baudrate)
 {
-    int baudr,
-        status;
-
-    if ((comport_number >= RS232_PORTNR) || (comport_number < 0))
-    {
-        printf("illegal comport number\n");
-        return (1);
-    }
-
     switch (baudrate)
     {
     case 50:
-        baudr = B50;
-        break;
+        return B50;
     case 75:
-        baudr = B75;
-        break;
+        return B75;
     case 110:
-        baudr = B110;
-        break;
+        return B110;
     case 134:
-        baudr = B134;
-        break;
+        return B134;
     case 150:
-        baudr = B150;
-        break;
+        return B150;
     case 200:
-        baudr = B200;
-        break;
+        return B200;
     case 300:
-        baudr = B300;
-        break;
+        return B300;
     case 600:
-        baudr = B600;
-        break;
+        return B600;
     case 1200:
-        baudr = B1200;
-        break;
+        return B1200;
     case 1800:
-        baudr = B1800;
-        break;
+        return B1800;
     case 2400:
-        baudr = B2400;
-        break;
+        return B2400;
     case 4800:
-        baudr = B4800;
-        break;
+        return B4800;
     case 9600:
-        baudr = B9600;
-        break;
+        return B9600;
     case 19200:
-        baudr = B19200;
-        break;
+        return B19200;
     case 38400:
-        baudr = B38400;
-        break;
+        return B38400;
     case 57600:
-        baudr = B57600;
-        break;
+        return B57600;
     case 115200:
-        baudr = B115200;
-        break;
+        return B115200;
     case 230400:
-        baudr = B230400;
-        break;
+        return B230400;
     case 460800:
-        baudr = B460800;
-        break;
+        return B460800;
     case 500000:
-        baudr = B500000;
-        break;
+        return B500000;
     case 576000:
-        baudr = B576000;
-        break;
+        return B576000;
     case 921600:
-        baudr = B921600;
-        break;
+        return B921600;
     case 1000000:
-        baudr = B1000000;
-        break;
+        return B1000000;
     case 1152000:
-        baudr = B1152000;
-        break;
+        return B1152000;
     case 1500000:
-        baudr = B1500000;
-        break;
+        return B1500000;
     case 2000000:
-        baudr = B2000000;
-        break;
+        return B2000000;
     case 2500000:
-        baudr = B2500000;
-        break;
+        return B2500000;
     case 3000000:
-        baudr = B3000000;
-        break;
+        return B3000000;
     case 3500000:
-        baudr = B3500000;
-        break;
+        return B3500000;
     case 4000000:
-        baudr = B4000000;
-        break;
+        return B4000000;
     default:
+        return (-1);
+    }
+}
+
+struct RS232_Port
+{
+    int fd;
+    struct termios old_settings; /* restored on close */
+    char device[RS232_NAME_SIZE];
+    RS232_Stats stats;
+};
+
+/* make reads wait for the first byte and ask the driver to pass bytes on at once */
+static void RS232_ApplyLowLatency(RS232_Port *port)
+{
+    int flags = fcntl(port->fd, F_GETFL);
+
+    /* without O_NDELAY a read waits up to VTIME for data and returns as soon as a byte arrives */
+    if ((flags == -1) || (fcntl(port->fd, F_SETFL, flags & ~O_NDELAY) == -1))
+    {
+        perror("unable to make reads wait for data");
+    }
+
+#if defined(__linux__) && defined(TIOCGSERIAL)
+    struct serial_struct serial;
+
+    /* USB adapters otherwise hold received bytes for their latency timer, 16 ms on FTDI */
+    if ((ioctl(port->fd, TIOCGSERIAL, &serial) == -1) ||
+        ((serial.flags |= ASYNC_LOW_LATENCY), ioctl(port->fd, TIOCSSERIAL, &serial) == -1))
+    {
+        fprintf(stderr, "low latency mode not available on %s (%s), replies may be held back by the adapter\n",
+                port->device, strerror(errno));
+    }
+#else
+    fprintf(stderr, "low latency mode is not supported on this system, replies may be held back by the adapter\n");
+#endif
+}
+
+/* undo what RS232_Open did so far and report why it stopped */
+static RS232_Port *RS232_FailOpen(RS232_Port *port, int restore, const char *message)
+{
+    perror(message);
+    if (restore)
+    {
+        tcsetattr(port->fd, TCSANOW, &port->old_settings);
+    }
+    flock(port->fd, LOCK_UN); /* free the port so that others can use it. */
+    close(port->fd);
+    free(port);
+    return (NULL);
+}
+
+RS232_Port *RS232_Open(const char *device, int baudrate, const char *mode, int options)
+{
+    int baudr,
+        status;
+
+    struct termios new_port_settings;
+
+    RS232_Port *port;
+
+    baudr = RS232_BaudConstant(baudrate);
+    if (baudr == -1)
+    {
         printf("invalid baudrate\n");
-        return (1);
-        break;
+        return (NULL);
     }
 
     int cbits = CS8,
@@ -167,7 +188,7 @@ int RS232_OpenComport(int comport_number, int baudrate, const char *mode)
     if (strlen(mode) != 3)
     {
         printf("invalid mode \"%s\"\n", mode);
-        return (1);
+        return (NULL);
     }
 
     switch (mode[0])
@@ -186,7 +207,7 @@ int RS232_OpenComport(int comport_number, int baudrate, const char *mode)
         break;
     default:
         printf("invalid number of data-bits '%c'\n", mode[0]);
-        return (1);
+        return (NULL);
         break;
     }
 
@@ -209,7 +230,7 @@ int RS232_OpenComport(int comport_number, int baudrate, const char *mode)
         break;
     default:
         printf("invalid parity '%c'\n", mode[1]);
-        return (1);
+        return (NULL);
         break;
     }
 
@@ -223,121 +244,128 @@ int RS232_OpenComport(int comport_number, int baudrate, const char *mode)
         break;
     default:
         printf("invalid number of stop bits '%c'\n", mode[2]);
-        return (1);
+        return (NULL);
         break;
     }
 
+    if (strlen(device) >= RS232_NAME_SIZE)
+    {
+        printf("device name too long: %s\n", device);
+        return (NULL);
+    }
+
+    port = calloc(1, sizeof(RS232_Port));
+    if (port == NULL)
+    {
+        printf("out of memory\n");
+        return (NULL);
+    }
+    strcpy(port->device, device);
+
     /*
     http://pubs.opengroup.org/onlinepubs/7908799/xsh/termios.h.html
 
     http://man7.org/linux/man-pages/man3/termios.3.html
     */
 
-    Cport[comport_number] = open(comports[comport_number], O_RDWR | O_NOCTTY | O_NDELAY);
-    if (Cport[comport_number] == -1)
+    port->fd = open(device, O_RDWR | O_NOCTTY | O_NDELAY);
+    if (port->fd == -1)
     {
         perror("unable to open comport ");
-        return (1);
+        free(port);
+        return (NULL);
     }
 
     /* lock access so that another process can't also use the port */
-    if (flock(Cport[comport_number], LOCK_EX | LOCK_NB) != 0)
+    if (flock(port->fd, LOCK_EX | LOCK_NB) != 0)
     {
-        close(Cport[comport_number]);
+        close(port->fd);
+        free(port);
         perror("Another process has locked the comport.");
-        return (1);
+        return (NULL);
     }
 
-    error = tcgetattr(Cport[comport_number], old_port_settings + comport_number);
-    if (error == -1)
+    if (tcgetattr(port->fd, &port->old_settings) == -1)
     {
-        close(Cport[comport_number]);
-        flock(Cport[comport_number], LOCK_UN); /* free the port so that others can use it. */
-        perror("unable to read portsettings ");
-        return (1);
+        return RS232_FailOpen(port, 0, "unable to read portsettings ");
     }
     memset(&new_port_settings, 0, sizeof(new_port_settings)); /* clear the new struct */
 
     new_port_settings.c_cflag = cbits | cpar | bstop | CLOCAL | CREAD;
+    if (options & RS232_HW_FLOW)
+    {
+        new_port_settings.c_cflag |= CRTSCTS; /* the UART holds output while CTS is low */
+    }
     new_port_settings.c_iflag = ipar;
     new_port_settings.c_oflag = 0;
     new_port_settings.c_lflag = 0;
     new_port_settings.c_cc[VMIN] = 0;  /* block untill n bytes are received */
     new_port_settings.c_cc[VTIME] = 0; /* block untill a timer expires (n * 100 mSec.) */
+    if (options & RS232_LOW_LATENCY)
+    {
+        new_port_settings.c_cc[VTIME] = RS232_READ_WAIT; /* reads return on the first byte or after this */
+    }
 
     cfsetispeed(&new_port_settings, baudr);
     cfsetospeed(&new_port_settings, baudr);
 
-    error = tcsetattr(Cport[comport_number], TCSANOW, &new_port_settings);
-    if (error == -1)
+    if (tcsetattr(port->fd, TCSANOW, &new_port_settings) == -1)
     {
-        tcsetattr(Cport[comport_number], TCSANOW, old_port_settings + comport_number);
-        close(Cport[comport_number]);
-        flock(Cport[comport_number], LOCK_UN); /* free the port so that others can use it. */
-        perror("unable to adjust portsettings ");
-        return (1);
+        return RS232_FailOpen(port, 1, "unable to adjust portsettings ");
+    }
+
+    if (options & RS232_LOW_LATENCY)
+    {
+        RS232_ApplyLowLatency(port);
     }
 
     /* http://man7.org/linux/man-pages/man4/tty_ioctl.4.html */
 
-    if (ioctl(Cport[comport_number], TIOCMGET, &status) == -1)
+    if (ioctl(port->fd, TIOCMGET, &status) == -1)
     {
-        tcsetattr(Cport[comport_number], TCSANOW, old_port_settings + comport_number);
-        flock(Cport[comport_number], LOCK_UN); /* free the port so that others can use it. */
-        perror("unable to get portstatus");
-        return (1);
+        if ((errno == ENOTTY) || (errno == EINVAL))
+            return (port); /* no modem lines, e.g. a pseudo terminal */
+
+        return RS232_FailOpen(port, 1, "unable to get portstatus");
     }
 
     status |= TIOCM_DTR; /* turn on DTR */
     status |= TIOCM_RTS; /* turn on RTS */
 
-    if (ioctl(Cport[comport_number], TIOCMSET, &status) == -1)
+    if (ioctl(port->fd, TIOCMSET, &status) == -1)
     {
-        tcsetattr(Cport[comport_number], TCSANOW, old_port_settings + comport_number);
-        flock(Cport[comport_number], LOCK_UN); /* free the port so that others can use it. */
-        perror("unable to set portstatus");
-        return (1);
+        return RS232_FailOpen(port, 1, "unable to set portstatus");
     }
 
-    return (0);
+    if ((options & RS232_HW_FLOW) && !(status & TIOCM_CTS))
+    {
+        printf("CTS is low on %s, output waits until the other end raises it\n", port->device);
+    }
+
+    return (port);
 }
 
-int RS232_PollComport(int comport_number, unsigned char *buf, int size)
+int RS232_Read(RS232_Port *port, unsigned char *buf, int size)
 {
     int n;
 
-    n = read(Cport[comport_number], buf, size);
+    n = read(port->fd, buf, size);
 
     if (n < 0)
     {
         if (errno == EAGAIN)
             return 0;
+        port->stats.read_errors++;
+        return (n);
     }
 
+    port->stats.bytes_received += n;
     return (n);
 }
 
-int RS232_SendByte(int comport_number, unsigned char byte)
+int RS232_Write(RS232_Port *port, const unsigned char *buf, int size)
 {
-    int n = write(Cport[comport_number], &byte, 1);
-    if (n < 0)
-    {
-        if (errno == EAGAIN)
-        {
-            return 0;
-        }
-        else
-        {
-            return 1;
-        }
-    }
-
-    return (0);
-}
-
-int RS232_SendBuf(int comport_number, unsigned char *buf, int size)
-{
-    int n = write(Cport[comport_number], buf, size);
+    int n = write(port->fd, buf, size);
     if (n < 0)
     {
         if (errno == EAGAIN)
@@ -346,34 +374,39 @@ int RS232_SendBuf(int comport_number, unsigned char *buf, int size)
         }
         else
         {
+            port->stats.write_errors++;
             return -1;
         }
     }
 
+    port->stats.bytes_sent += n;
     return (n);
 }
 
-void RS232_CloseComport(int comport_number)
+void RS232_Close(RS232_Port *port)
 {
     int status;
 
-    if (ioctl(Cport[comport_number], TIOCMGET, &status) == -1)
+    if (ioctl(port->fd, TIOCMGET, &status) == -1)
     {
-        perror("unable to get portstatus");
+        if ((errno != ENOTTY) && (errno != EINVAL)) /* no modem lines, e.g. a pseudo terminal */
+            perror("unable to get portstatus");
     }
-
-    status &= ~TIOCM_DTR; /* turn off DTR */
-    status &= ~TIOCM_RTS; /* turn off RTS */
-
-    if (ioctl(Cport[comport_number], TIOCMSET, &status) == -1)
+    else
     {
-        perror("unable to set portstatus");
-    }
+        status &= ~TIOCM_DTR; /* turn off DTR */
+        status &= ~TIOCM_RTS; /* turn off RTS */
 
-    tcsetattr(Cport[comport_number], TCSANOW, old_port_settings + comport_number);
-    close(Cport[comport_number]);
+        if (ioctl(port->fd, TIOCMSET, &status) == -1)
+        {
+            perror("unable to set portstatus");
+        }
+    }
 
-    flock(Cport[comport_number], LOCK_UN); /* free the port so that others can use it. */
+    tcsetattr(port->fd, TCSANOW, &port->old_settings);
+    flock(port->fd, LOCK_UN); /* free the port so that others can use it. */
+    close(port->fd);
+    free(port);
 }
 
 /*
@@ -393,145 +426,112 @@ TIOCM_DSR       DSR (data set ready)
 http://man7.org/linux/man-pages/man4/tty_ioctl.4.html
 */
 
-int RS232_IsDCDEnabled(int comport_number)
+/* RS232_DCD, RS232_CTS and RS232_DSR as they are now, 0 when they cannot be read */
+int RS232_GetModemLines(RS232_Port *port)
 {
-    int status;
-
-    ioctl(Cport[comport_number], TIOCMGET, &status);
+    int status,
+        lines = 0;
 
-    if (status & TIOCM_CAR)
-        return (1);
-    else
+    if (ioctl(port->fd, TIOCMGET, &status) == -1)
         return (0);
-}
-
-int RS232_IsCTSEnabled(int comport_number)
-{
-    int status;
-
-    ioctl(Cport[comport_number], TIOCMGET, &status);
 
+    if (status & TIOCM_CAR)
+        lines |= RS232_DCD;
     if (status & TIOCM_CTS)
-        return (1);
-    else
-        return (0);
-}
-
-int RS232_IsDSREnabled(int comport_number)
-{
-    int status;
-
-    ioctl(Cport[comport_number], TIOCMGET, &status);
-
+        lines |= RS232_CTS;
     if (status & TIOCM_DSR)
-        return (1);
-    else
-        return (0);
+        lines |= RS232_DSR;
+
+    return (lines);
 }
 
-void RS232_enableDTR(int comport_number)
+/* raise or lower RS232_DTR or RS232_RTS */
+void RS232_SetModemLine(RS232_Port *port, int line, int on)
 {
-    int status;
+    int status,
+        bit = (line == RS232_DTR) ? TIOCM_DTR : TIOCM_RTS;
 
-    if (ioctl(Cport[comport_number], TIOCMGET, &status) == -1)
+    if (ioctl(port->fd, TIOCMGET, &status) == -1)
     {
         perror("unable to get portstatus");
     }
 
-    status |= TIOCM_DTR; /* turn on DTR */
+    if (on)
+        status |= bit;
+    else
+        status &= ~bit;
 
-    if (ioctl(Cport[comport_number], TIOCMSET, &status) == -1)
+    if (ioctl(port->fd, TIOCMSET, &status) == -1)
     {
         perror("unable to set portstatus");
     }
 }
 
-void RS232_disableDTR(int comport_number)
+void RS232_Flush(RS232_Port *port, int queues)
 {
-    int status;
-
-    if (ioctl(Cport[comport_number], TIOCMGET, &status) == -1)
-    {
-        perror("unable to get portstatus");
-    }
-
-    status &= ~TIOCM_DTR; /* turn off DTR */
-
-    if (ioctl(Cport[comport_number], TIOCMSET, &status) == -1)
-    {
-        perror("unable to set portstatus");
-    }
+    if (queues == (RS232_FLUSH_RX | RS232_FLUSH_TX))
+        tcflush(port->fd, TCIOFLUSH);
+    else if (queues == RS232_FLUSH_RX)
+        tcflush(port->fd, TCIFLUSH);
+    else if (queues == RS232_FLUSH_TX)
+        tcflush(port->fd, TCOFLUSH);
 }
 
-void RS232_enableRTS(int comport_number)
+/* change the speed of an open port without closing it, so DTR is not toggled */
+int RS232_SetPortBaudrate(RS232_Port *port, int baudrate)
 {
-    int status;
-
-    if (ioctl(Cport[comport_number], TIOCMGET, &status) == -1)
-    {
-        perror("unable to get portstatus");
-    }
+    int baudr;
 
-    status |= TIOCM_RTS; /* turn on RTS */
+    struct termios settings;
 
-    if (ioctl(Cport[comport_number], TIOCMSET, &status) == -1)
+    baudr = RS232_BaudConstant(baudrate);
+    if (baudr == -1)
     {
-        perror("unable to set portstatus");
+        printf("invalid baudrate\n");
+        return (1);
     }
-}
-
-void RS232_disableRTS(int comport_number)
-{
-    int status;
 
-    if (ioctl(Cport[comport_number], TIOCMGET, &status) == -1)
+    if (tcgetattr(port->fd, &settings) == -1)
     {
-        perror("unable to get portstatus");
+        perror("unable to read portsettings ");
+        return (1);
     }
 
-    status &= ~TIOCM_RTS; /* turn off RTS */
+    cfsetispeed(&settings, baudr);
+    cfsetospeed(&settings, baudr);
 
-    if (ioctl(Cport[comport_number], TIOCMSET, &status) == -1)
+    if (tcsetattr(port->fd, TCSADRAIN, &settings) == -1)
     {
-        perror("unable to set portstatus");
+        perror("unable to adjust portsettings ");
+        return (1);
     }
-}
 
-void RS232_flushRX(int comport_number)
-{
-    tcflush(Cport[comport_number], TCIFLUSH);
-}
-
-void RS232_flushTX(int comport_number)
-{
-    tcflush(Cport[comport_number], TCOFLUSH);
-}
+    tcflush(port->fd, TCIFLUSH);
 
-void RS232_flushRXTX(int comport_number)
-{
-    tcflush(Cport[comport_number], TCIOFLUSH);
+    return (0);
 }
 
 #else /* windows */
 
 #define RS232_PORTNR 16
 
-HANDLE Cport[RS232_PORTNR];
-
 char *comports[RS232_PORTNR] = {"\\\\.\\COM1", "\\\\.\\COM2", "\\\\.\\COM3", "\\\\.\\COM4",
                                 "\\\\.\\COM5", "\\\\.\\COM6", "\\\\.\\COM7", "\\\\.\\COM8",
                                 "\\\\.\\COM9", "\\\\.\\COM10", "\\\\.\\COM11", "\\\\.\\COM12",
                                 "\\\\.\\COM13", "\\\\.\\COM14", "\\\\.\\COM15", "\\\\.\\COM16"};
 
-char mode_str[128];
+struct RS232_Port
+{
+    HANDLE handle;
+    char device[RS232_NAME_SIZE];
+    RS232_Stats stats;
+};
 
-int RS232_OpenComport(int comport_number, int baudrate, const char *mode)
+RS232_Port *RS232_Open(const char *device, int baudrate, const char *mode, int options)
 {
-    if ((comport_number >= RS232_PORTNR) || (comport_number < 0))
-    {
-        printf("illegal comport number\n");
-        return (1);
-    }
+    char mode_str[128];
+
+    RS232_Port *port;
 
     switch (baudrate)
     {
@@ -582,14 +582,14 @@ int RS232_OpenComport(int comport_number, int baudrate, const char *mode)
         break;
     default:
         printf("invalid baudrate\n");
-        return (1);
+        return (NULL);
         break;
     }
 
     if (strlen(mode) != 3)
     {
         printf("invalid mode \"%s\"\n", mode);
-        return (1);
+        return (NULL);
     }
 
     switch (mode[0])
@@ -608,7 +608,7 @@ int RS232_OpenComport(int comport_number, int baudrate, const char *mode)
         break;
     default:
         printf("invalid number of data-bits '%c'\n", mode[0]);
-        return (1);
+        return (NULL);
         break;
     }
 
@@ -628,7 +628,7 @@ int RS232_OpenComport(int comport_number, int baudrate, const char *mode)
         break;
     default:
         printf("invalid parity '%c'\n", mode[1]);
-        return (1);
+        return (NULL);
         break;
     }
 
@@ -642,11 +642,32 @@ int RS232_OpenComport(int comport_number, int baudrate, const char *mode)
         break;
     default:
         printf("invalid number of stop bits '%c'\n", mode[2]);
-        return (1);
+        return (NULL);
         break;
     }
 
-    strcat(mode_str, " dtr=on rts=on");
+    if (options & RS232_HW_FLOW)
+    {
+        strcat(mode_str, " dtr=on rts=hs octs=on"); /* the UART holds output while CTS is low */
+    }
+    else
+    {
+        strcat(mode_str, " dtr=on rts=on");
+    }
+
+    if (strlen(device) >= RS232_NAME_SIZE)
+    {
+        printf("device name too long: %s\n", device);
+        return (NULL);
+    }
+
+    port = calloc(1, sizeof(RS232_Port));
+    if (port == NULL)
+    {
+        printf("out of memory\n");
+        return (NULL);
+    }
+    strcpy(port->device, device);
 
     /*
     http://msdn.microsoft.com/en-us/library/windows/desktop/aa363145%28v=vs.85%29.aspx
@@ -654,18 +675,19 @@ int RS232_OpenComport(int comport_number, int baudrate, const char *mode)
     http://technet.microsoft.com/en-us/library/cc732236.aspx
     */
 
-    Cport[comport_number] = CreateFileA(comports[comport_number],
-                                        GENERIC_READ | GENERIC_WRITE,
-                                        0,    /* no share  */
-                                        NULL, /* no security */
-                                        OPEN_EXISTING,
-                                        0,     /* no threads */
-                                        NULL); /* no templates */
+    port->handle = CreateFileA(device,
+                               GENERIC_READ | GENERIC_WRITE,
+                               0,    /* no share  */
+                               NULL, /* no security */
+                               OPEN_EXISTING,
+                               0,     /* no threads */
+                               NULL); /* no templates */
 
-    if (Cport[comport_number] == INVALID_HANDLE_VALUE)
+    if (port->handle == INVALID_HANDLE_VALUE)
     {
         printf("unable to open comport\n");
-        return (1);
+        free(port);
+        return (NULL);
     }
 
     DCB port_settings;
@@ -675,15 +697,17 @@ int RS232_OpenComport(int comport_number, int baudrate, const char *mode)
     if (!BuildCommDCBA(mode_str, &port_settings))
     {
         printf("unable to set comport dcb settings\n");
-        CloseHandle(Cport[comport_number]);
-        return (1);
+        CloseHandle(port->handle);
+        free(port);
+        return (NULL);
     }
 
-    if (!SetCommState(Cport[comport_number], &port_settings))
+    if (!SetCommState(port->handle, &port_settings))
     {
         printf("unable to set comport cfg settings\n");
-        CloseHandle(Cport[comport_number]);
-        return (1);
+        CloseHandle(port->handle);
+        free(port);
+        return (NULL);
     }
 
     COMMTIMEOUTS Cptimeouts;
@@ -691,141 +715,298 @@ int RS232_OpenComport(int comport_number, int baudrate, const char *mode)
     Cptimeouts.ReadIntervalTimeout = MAXDWORD;
     Cptimeouts.ReadTotalTimeoutMultiplier = 0;
     Cptimeouts.ReadTotalTimeoutConstant = 0;
+
+    if (options & RS232_LOW_LATENCY)
+    {
+        /* ReadFile returns as soon as a byte is there, and waits for one up to the constant */
+        Cptimeouts.ReadTotalTimeoutMultiplier = MAXDWORD;
+        Cptimeouts.ReadTotalTimeoutConstant = RS232_READ_WAIT * 100;
+        fprintf(stderr, "low latency mode cannot change the adapter latency timer on Windows, set it in the driver\n");
+    }
     Cptimeouts.WriteTotalTimeoutMultiplier = 0;
     Cptimeouts.WriteTotalTimeoutConstant = 0;
 
-    if (!SetCommTimeouts(Cport[comport_number], &Cptimeouts))
+    if (!SetCommTimeouts(port->handle, &Cptimeouts))
     {
         printf("unable to set comport time-out settings\n");
-        CloseHandle(Cport[comport_number]);
-        return (1);
+        CloseHandle(port->handle);
+        free(port);
+        return (NULL);
     }
 
-    return (0);
+    return (port);
 }
 
-int RS232_PollComport(int comport_number, unsigned char *buf, int size)
+int RS232_Read(RS232_Port *port, unsigned char *buf, int size)
 {
-    int n;
+    DWORD n = 0;
 
-    /* added the void pointer cast, otherwise gcc will complain about */
-    /* "warning: dereferencing type-punned pointer will break strict aliasing rules" */
+    if (!ReadFile(port->handle, buf, size, &n, NULL))
+    {
+        port->stats.read_errors++;
+        return (-1);
+    }
 
-    ReadFile(Cport[comport_number], buf, size, (LPDWORD)((void *)&n), NULL);
+    port->stats.bytes_received += n;
+    return ((int)n);
+}
 
-    return (n);
+int RS232_Write(RS232_Port *port, const unsigned char *buf, int size)
+{
+    DWORD n = 0;
+
+    if (!WriteFile(port->handle, buf, size, &n, NULL))
+    {
+        port->stats.write_errors++;
+        return (-1);
+    }
+
+    port->stats.bytes_sent += n;
+    return ((int)n);
 }
 
-int RS232_SendByte(int comport_number, unsigned char byte)
+void RS232_Close(RS232_Port *port)
 {
-    int n;
+    CloseHandle(port->handle);
+    free(port);
+}
 
-    WriteFile(Cport[comport_number], &byte, 1, (LPDWORD)((void *)&n), NULL);
+/*
+http://msdn.microsoft.com/en-us/library/windows/desktop/aa363258%28v=vs.85%29.aspx
+*/
 
-    if (n < 0)
-        return (1);
+/* RS232_DCD, RS232_CTS and RS232_DSR as they are now, 0 when they cannot be read */
+int RS232_GetModemLines(RS232_Port *port)
+{
+    DWORD status;
+    int lines = 0;
 
-    return (0);
+    if (!GetCommModemStatus(port->handle, &status))
+        return (0);
+
+    if (status & MS_RLSD_ON)
+        lines |= RS232_DCD;
+    if (status & MS_CTS_ON)
+        lines |= RS232_CTS;
+    if (status & MS_DSR_ON)
+        lines |= RS232_DSR;
+
+    return (lines);
 }
 
-int RS232_SendBuf(int comport_number, unsigned char *buf, int size)
+/* raise or lower RS232_DTR or RS232_RTS */
+void RS232_SetModemLine(RS232_Port *port, int line, int on)
 {
-    int n;
+    if (line == RS232_DTR)
+        EscapeCommFunction(port->handle, on ? SETDTR : CLRDTR);
+    else
+        EscapeCommFunction(port->handle, on ? SETRTS : CLRRTS);
+}
 
-    if (WriteFile(Cport[comport_number], buf, size, (LPDWORD)((void *)&n), NULL))
+/*
+https://msdn.microsoft.com/en-us/library/windows/desktop/aa363428%28v=vs.85%29.aspx
+*/
+
+void RS232_Flush(RS232_Port *port, int queues)
+{
+    if (queues & RS232_FLUSH_RX)
+        PurgeComm(port->handle, PURGE_RXCLEAR | PURGE_RXABORT);
+    if (queues & RS232_FLUSH_TX)
+        PurgeComm(port->handle, PURGE_TXCLEAR | PURGE_TXABORT);
+}
+
+/* change the speed of an open port without closing it, so DTR is not toggled */
+int RS232_SetPortBaudrate(RS232_Port *port, int baudrate)
+{
+    DCB port_settings;
+
+    memset(&port_settings, 0, sizeof(port_settings));
+    port_settings.DCBlength = sizeof(port_settings);
+
+    if (!GetCommState(port->handle, &port_settings))
     {
-        return (n);
+        printf("unable to read comport cfg settings\n");
+        return (1);
+    }
+
+    port_settings.BaudRate = baudrate;
+
+    if (!SetCommState(port->handle, &port_settings))
+    {
+        printf("invalid baudrate\n");
+        return (1);
     }
 
-    return (-1);
+    PurgeComm(port->handle, PURGE_RXCLEAR | PURGE_RXABORT);
+
+    return (0);
 }
 
-void RS232_CloseComport(int comport_number)
+#endif
+
+const char *RS232_PortDevice(const RS232_Port *port)
 {
-    CloseHandle(Cport[comport_number]);
+    return port->device;
+}
+
+/* counters since the port was opened */
+void RS232_GetStats(const RS232_Port *port, RS232_Stats *stats)
+{
+    *stats = port->stats;
 }
 
 /*
-http://msdn.microsoft.com/en-us/library/windows/desktop/aa363258%28v=vs.85%29.aspx
+The original interface. A comport number indexes comports[] for the device and
+legacy_ports[] for the handle opened on it, everything else is the handle call.
 */
 
-int RS232_IsDCDEnabled(int comport_number)
+static RS232_Port *legacy_ports[RS232_PORTNR];
+
+/* the handle opened on a comport number, NULL if there is none */
+static RS232_Port *RS232_LegacyPort(int comport_number)
 {
-    int status;
+    if ((comport_number >= RS232_PORTNR) || (comport_number < 0))
+    {
+        return NULL;
+    }
 
-    GetCommModemStatus(Cport[comport_number], (LPDWORD)((void *)&status));
+    return legacy_ports[comport_number];
+}
 
-    if (status & MS_RLSD_ON)
+int RS232_OpenComport(int comport_number, int baudrate, const char *mode)
+{
+    return RS232_OpenComportEx(comport_number, baudrate, mode, 0);
+}
+
+int RS232_OpenComportEx(int comport_number, int baudrate, const char *mode, int options)
+{
+    if ((comport_number >= RS232_PORTNR) || (comport_number < 0))
+    {
+        printf("illegal comport number\n");
         return (1);
-    else
-        return (0);
+    }
+
+    RS232_CloseComport(comport_number); /* reopening replaces the handle, the old one is closed first */
+
+    legacy_ports[comport_number] = RS232_Open(comports[comport_number], baudrate, mode, options);
+
+    return (legacy_ports[comport_number] ? 0 : 1);
 }
 
-int RS232_IsCTSEnabled(int comport_number)
+int RS232_PollComport(int comport_number, unsigned char *buf, int size)
 {
-    int status;
+    RS232_Port *port = RS232_LegacyPort(comport_number);
 
-    GetCommModemStatus(Cport[comport_number], (LPDWORD)((void *)&status));
+    return (port ? RS232_Read(port, buf, size) : -1);
+}
 
-    if (status & MS_CTS_ON)
-        return (1);
-    else
-        return (0);
+int RS232_SendByte(int comport_number, unsigned char byte)
+{
+    RS232_Port *port = RS232_LegacyPort(comport_number);
+
+    return ((port && RS232_Write(port, &byte, 1) >= 0) ? 0 : 1);
+}
+
+int RS232_SendBuf(int comport_number, unsigned char *buf, int size)
+{
+    RS232_Port *port = RS232_LegacyPort(comport_number);
+
+    return (port ? RS232_Write(port, buf, size) : -1);
+}
+
+void RS232_CloseComport(int comport_number)
+{
+    RS232_Port *port = RS232_LegacyPort(comport_number);
+
+    if (port)
+    {
+        RS232_Close(port);
+        legacy_ports[comport_number] = NULL;
+    }
+}
+
+int RS232_IsDCDEnabled(int comport_number)
+{
+    RS232_Port *port = RS232_LegacyPort(comport_number);
+
+    return ((port && (RS232_GetModemLines(port) & RS232_DCD)) ? 1 : 0);
+}
+
+int RS232_IsCTSEnabled(int comport_number)
+{
+    RS232_Port *port = RS232_LegacyPort(comport_number);
+
+    return ((port && (RS232_GetModemLines(port) & RS232_CTS)) ? 1 : 0);
 }
 
 int RS232_IsDSREnabled(int comport_number)
 {
-    int status;
+    RS232_Port *port = RS232_LegacyPort(comport_number);
 
-    GetCommModemStatus(Cport[comport_number], (LPDWORD)((void *)&status));
+    return ((port && (RS232_GetModemLines(port) & RS232_DSR)) ? 1 : 0);
+}
 
-    if (status & MS_DSR_ON)
-        return (1);
-    else
-        return (0);
+static void RS232_LegacyModemLine(int comport_number, int line, int on)
+{
+    RS232_Port *port = RS232_LegacyPort(comport_number);
+
+    if (port)
+    {
+        RS232_SetModemLine(port, line, on);
+    }
 }
 
 void RS232_enableDTR(int comport_number)
 {
-    EscapeCommFunction(Cport[comport_number], SETDTR);
+    RS232_LegacyModemLine(comport_number, RS232_DTR, 1);
 }
 
 void RS232_disableDTR(int comport_number)
 {
-    EscapeCommFunction(Cport[comport_number], CLRDTR);
+    RS232_LegacyModemLine(comport_number, RS232_DTR, 0);
 }
 
 void RS232_enableRTS(int comport_number)
 {
-    EscapeCommFunction(Cport[comport_number], SETRTS);
+    RS232_LegacyModemLine(comport_number, RS232_RTS, 1);
 }
 
 void RS232_disableRTS(int comport_number)
 {
-    EscapeCommFunction(Cport[comport_number], CLRRTS);
+    RS232_LegacyModemLine(comport_number, RS232_RTS, 0);
 }
 
-/*
-https://msdn.microsoft.com/en-us/library/windows/desktop/aa363428%28v=vs.85%29.aspx
-*/
+static void RS232_LegacyFlush(int comport_number, int queues)
+{
+    RS232_Port *port = RS232_LegacyPort(comport_number);
+
+    if (port)
+    {
+        RS232_Flush(port, queues);
+    }
+}
 
 void RS232_flushRX(int comport_number)
 {
-    PurgeComm(Cport[comport_number], PURGE_RXCLEAR | PURGE_RXABORT);
+    RS232_LegacyFlush(comport_number, RS232_FLUSH_RX);
 }
 
 void RS232_flushTX(int comport_number)
 {
-    PurgeComm(Cport[comport_number], PURGE_TXCLEAR | PURGE_TXABORT);
+    RS232_LegacyFlush(comport_number, RS232_FLUSH_TX);
 }
 
 void RS232_flushRXTX(int comport_number)
 {
-    PurgeComm(Cport[comport_number], PURGE_RXCLEAR | PURGE_RXABORT);
-    PurgeComm(Cport[comport_number], PURGE_TXCLEAR | PURGE_TXABORT);
+    RS232_LegacyFlush(comport_number, RS232_FLUSH_RX | RS232_FLUSH_TX);
 }
 
-#endif
+int RS232_SetBaudrate(int comport_number, int baudrate)
+{
+    RS232_Port *port = RS232_LegacyPort(comport_number);
+
+    return (port ? RS232_SetPortBaudrate(port, baudrate) : 1);
+}
 
 void RS232_cputs(int comport_number, const char *text) /* sends a string to serial port */
 {
@@ -858,3 +1039,30 @@ int RS232_GetPortnr(const char *devname)
 
     return -1; /* device not found */
 }
+
+/* return the device name behind a comport number, or NULL if out of range */
+const char *RS232_GetPortName(int comport_number)
+{
+    if ((comport_number >= RS232_PORTNR) || (comport_number < 0))
+    {
+        return NULL;
+    }
+
+    return comports[comport_number];
+}
+
+/* point a comport number at another device, e.g. a pseudo terminal */
+int RS232_SetPortName(int comport_number, const char *devname)
+{
+    static char names[RS232_PORTNR][RS232_NAME_SIZE];
+
+    if ((comport_number >= RS232_PORTNR) || (comport_number < 0) || (strlen(devname) >= sizeof(names[0])))
+    {
+        return (1);
+    }
+
+    strcpy(names[comport_number], devname);
+    comports[comport_number] = names[comport_number];
+
+    return (0);
+}
@@ -51,6 +51,9 @@ extern "C"
 #include <limits.h>
 #include <sys/file.h>
 #include <errno.h>
+#ifdef __linux__
+#include <linux/serial.h>
+#endif
 
 #else
 
@@ -58,7 +61,48 @@ extern "C"
 
 #endif
 
+#define RS232_LOW_LATENCY 1 /* option: reads wait for the first byte instead of polling, ASYNC_LOW_LATENCY */
+#define RS232_HW_FLOW 2     /* option: RTS/CTS hardware handshaking */
+#define RS232_READ_WAIT 1   /* longest wait for data in low latency mode, in 100 mSec. */
+#define RS232_NAME_SIZE 64  /* longest device name, terminator included */
+
+#define RS232_FLUSH_RX 1 /* queues for RS232_Flush */
+#define RS232_FLUSH_TX 2
+
+#define RS232_DTR 1  /* lines for RS232_SetModemLine */
+#define RS232_RTS 2
+#define RS232_DCD 4  /* bits of RS232_GetModemLines */
+#define RS232_CTS 8
+#define RS232_DSR 16
+
+    /* An open port. Its descriptor, settings and counters all live in the handle, so
+       separate ports can be driven from separate threads without any locking. On one
+       handle, one thread may read while another writes, the counters of each direction
+       are kept apart. */
+    typedef struct RS232_Port RS232_Port;
+
+    typedef struct
+    {
+        unsigned long long bytes_sent;
+        unsigned long long bytes_received;
+        unsigned long write_errors;
+        unsigned long read_errors;
+    } RS232_Stats;
+
+    RS232_Port *RS232_Open(const char *, int, const char *, int); /* device, baudrate, mode, options; NULL on failure */
+    int RS232_Read(RS232_Port *, unsigned char *, int);
+    int RS232_Write(RS232_Port *, const unsigned char *, int);
+    void RS232_Close(RS232_Port *);
+    int RS232_SetPortBaudrate(RS232_Port *, int);
+    int RS232_GetModemLines(RS232_Port *);
+    void RS232_SetModemLine(RS232_Port *, int, int);
+    void RS232_Flush(RS232_Port *, int);
+    const char *RS232_PortDevice(const RS232_Port *);
+    void RS232_GetStats(const RS232_Port *, RS232_Stats *);
+
+    /* the original interface, each comport number maps to a handle kept by rs232.c */
     int RS232_OpenComport(int, int, const char *);
+    int RS232_OpenComportEx(int, int, const char *, int);
     int RS232_PollComport(int, unsigned char *, int);
     int RS232_SendByte(int, unsigned char);
     int RS232_SendBuf(int, unsigned char *, int);
@@ -75,6 +119,9 @@ extern "C"
     void RS232_flushTX(int);
     void RS232_flushRXTX(int);
     int RS232_GetPortnr(const char *);
+    int RS232_SetBaudrate(int, int);
+    const char *RS232_GetPortName(int);
+    int RS232_SetPortName(int, const char *);
 
 #ifdef __cplusplus
 } /* extern "C" */
@@ -1,152 +1,838 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
 
 #include "serial.h"
 #include "rs232.h"
+#include "timer.h"
+#include "status.h"
+#include "capture.h"
+#include "log.h"
+#include "trace.h"
+#include "transport.h"
+#include "reply.h"
 
 // #define Serial_Mode
 
 #ifdef Serial_Mode
+static const Transport *transport = &serial_transport;
+#else
+static const Transport *transport = &console_transport; // Print the commands instead of sending them
+#endif
+
+static const char *transport_target; // Set by SetSerialDevice, NULL for the transport's default
+static int hardware_flow;            // Set by SetHardwareFlow, the serial port opens with RTS/CTS
+static long pending_acks;            // Lines written to a transport that has nobody to answer them
+static int active_bdrate = bdrate;
+
+// The status poller writes '?' from its own thread, every write holds this lock so a real-time
+// byte never lands in the middle of a transport write
+static pthread_mutex_t write_lock = PTHREAD_MUTEX_INITIALIZER;
+static atomic_llong last_receive; // TimerMillis() of the last read for replies, the poller checks it
+
+// Received bytes are framed into lines here, a read can end anywhere in one or hold several
+static ReplyParser replies;
+static int unclaimed_acks;   // ok and error replies not yet taken by a wait or poll
+static int unclaimed_errors; // How many of those were errors
+static int banner_seen;      // The controller (re)started
+static int status_seen;      // A status report was parsed
+
+// Marlin style line numbering. Lines stay in the history until they are answered, so a
+// resend request is served from here without going back to the job.
+static int line_numbers;          // Set by SetLineNumbers
+static long next_number;          // Number of the next line sent
+static long answered_number = -1; // Last line answered with ok or error
+static long resend_from = -1;     // Line a resend request asked for, -1 if none is waiting
+static long last_resend = -1;     // Line sent again last
+static long stale_requests;       // Requests for it still due from lines sent before it went again
+static long unanswered;           // Numbered lines written, resent ones included, without a reply yet
+static int resend_oks;            // The ok that follows each resend request answers no line
+static long long last_answer;     // TimerMillis() of the last reply while lines were unanswered
+static long resent_lines;
+static char history[LINE_HISTORY][LINE_FRAMED_SIZE];
+static int history_length[LINE_HISTORY];
+
+// Rates tried when probing, fastest first
+static const int baud_candidates[] = {
+#if defined(__linux__) || defined(__FreeBSD__)
+    4000000, 3000000, 2000000, 1500000, 1000000, 921600, 500000, 460800, 230400,
+#else
+    1000000, 500000, 256000, 128000,
+#endif
+    115200, 57600, 38400, 19200, 9600};
 
-// Open port with checking
-int CanRS232PortBeOpened(void)
+static const char *baud_cache_file; // Set by SetBaudCacheFile, NULL for the default in the home directory, "" for none
+
+#define BAUD_CANDIDATE_COUNT (int)(sizeof(baud_candidates) / sizeof(baud_candidates[0]))
+
+// Reads of the low latency serial port and of TCP wait for the first byte of a reply
+static int ReadWaits(void)
+{
+    return transport->waits;
+}
+
+// All traffic goes through these so a capture sees every byte on the link
+static int ReadPort(unsigned char *buf, int size)
 {
-    char mode[] = {'8', 'N', '1', 0};
-    if (RS232_OpenComport(cport_nr, bdrate, mode))
+    int n = 0;
+
+    if (transport->acknowledges)
+    {
+        for (; pending_acks && n + 4 <= size; pending_acks--, n += 4)
+            memcpy(buf + n, "ok\r\n", 4);
+    }
+    else
+        n = transport->read(buf, size);
+
+    if (n > 0)
+        CaptureBytes(CAPTURE_RX, buf, n);
+    return n;
+}
+
+static int WriteBytes(const unsigned char *data, int length)
+{
+    int sent = 0, n, i;
+
+    pthread_mutex_lock(&write_lock);
+    while (sent < length)
     {
-        printf("Can not open comport\n");
+        n = transport->write(data + sent, length - sent);
+        if (n < 0)
+        {
+            pthread_mutex_unlock(&write_lock);
+            LogPrintf(LOG_ERROR, "Write to the controller failed");
+            return (-1);
+        }
+        if (n == 0)
+            Sleep(1); // Output queue full
+        sent += n;
+    }
+
+    if (transport->acknowledges)
+    {
+        for (i = 0; i < length; i++)
+            pending_acks += data[i] == '\n';
+    }
+    CaptureBytes(CAPTURE_TX, data, length);
+    pthread_mutex_unlock(&write_lock);
+    return (0);
+}
+
+static int WritePort(const char *text)
+{
+    return WriteBytes((const unsigned char *)text, (int)strlen(text));
+}
+
+static int WritePortByte(unsigned char byte)
+{
+    return WriteBytes(&byte, 1) ? 1 : 0;
+}
+
+// Frame one command as N<n> <command>*<checksum>, the checksum is the XOR of every byte before '*'
+static int SendNumbered(const char *command, int length)
+{
+    int slot = (int)(next_number & (LINE_HISTORY - 1));
+    char *framed = history[slot];
+    unsigned char checksum = 0;
+    int n, i;
 
+    n = snprintf(framed, LINE_FRAMED_SIZE, "N%ld %.*s", next_number, length, command);
+    if (n + 5 > LINE_FRAMED_SIZE)
+    {
+        LogPrintf(LOG_ERROR, "Command too long to number: %.*s", length, command);
         return (-1);
     }
-    return (0); // Success
+    for (i = 0; i < n; i++)
+        checksum ^= (unsigned char)framed[i];
+    n += sprintf(framed + n, "*%d\n", checksum);
+
+    history_length[slot] = n;
+    next_number++;
+    if (!unanswered++)
+        last_answer = TimerMillis();
+    return WriteBytes((const unsigned char *)framed, n);
 }
 
-// Function to close the COM port
-void CloseRS232Port(void)
+// Number each line of text, blank lines are dropped as they get no reply
+static int SendNumberedText(const char *text, int length)
 {
-    RS232_CloseComport(cport_nr);
+    const char *end = text + length;
+
+    while (text < end)
+    {
+        const char *newline = memchr(text, '\n', end - text);
+        int command = (int)((newline ? newline : end) - text);
+
+        while (command && (text[command - 1] == '\r' || text[command - 1] == ' '))
+            command--;
+        if (command && SendNumbered(text, command))
+            return (-1);
+        text = newline ? newline + 1 : end;
+    }
+    return (0);
 }
 
-// Write text out via the serial port
-int PrintBuffer(char *buffer)
+// Number lines from 0 again, M110 on line 0 sets the controller's count to match
+static int StartLineNumbers(void)
 {
-    RS232_cputs(cport_nr, buffer);
-    printf("sent: %s\n", buffer);
+    next_number = unanswered = stale_requests = 0;
+    answered_number = last_resend = resend_from = -1;
+    resend_oks = 0;
 
+    if (!line_numbers)
+        return (0);
+    if (SendNumbered("M110", 4) || WaitForReply())
+    {
+        LogPrintf(LOG_ERROR, "Controller did not accept line numbers");
+        return (-1);
+    }
     return (0);
 }
 
-int WaitForDollar(void)
+// Serve a resend request. The controller dropped every line after the damaged one as
+// well, so those are sent again in order. Lines before it were accepted, even if a
+// damaged reply kept their ok from being counted.
+static int ResendLines(void)
 {
+    long from = resend_from;
+    long line;
+
+    resend_from = -1;
+    if (from <= answered_number || from > next_number || next_number - from > LINE_HISTORY)
+    {
+        LogPrintf(LOG_ERROR, "Controller asked for line %ld, only lines %ld to %ld can be sent again", from,
+                  answered_number + 1, next_number - 1);
+        return (-1);
+    }
+
+    if (from - 1 > answered_number)
+    {
+        LogPrintf(LOG_WARN, "%ld replies lost before line %ld", from - 1 - answered_number, from);
+        unclaimed_acks += (int)(from - 1 - answered_number);
+        unanswered -= from - 1 - answered_number;
+        if (unanswered < 0)
+            unanswered = 0;
+        answered_number = from - 1;
+    }
 
-    int i, n;
+    // Each line still on its way was sent after the damaged one, the controller answers
+    // it with another request for this line
+    last_resend = from;
+    stale_requests = unanswered;
 
-    unsigned char buf[4096];
+    if (from == next_number)
+        return (0); // It has every line, a repeat sent after a silence was dropped
+    LogPrintf(LOG_WARN, "Resending lines %ld to %ld", from, next_number - 1);
+    for (line = from; line < next_number; line++)
+    {
+        int slot = (int)(line & (LINE_HISTORY - 1));
+        if (WriteBytes((const unsigned char *)history[slot], history_length[slot]))
+            return (-1);
+        unanswered++;
+        resent_lines++;
+    }
+    return (0);
+}
 
-    while (1)
+static void CountOk(void)
+{
+    if (resend_oks)
     {
-        printf(".");
-        n = RS232_PollComport(cport_nr, buf, 4095);
+        resend_oks--;
+        return;
+    }
+    unclaimed_acks++;
+    answered_number++;
+    unanswered--;
+}
+
+// Act on a resend request, it answers one line like an ok would
+static void RequestResend(long number)
+{
+    unanswered--;
+    resend_oks++;
+    if (!line_numbers)
+        LogPrintf(LOG_WARN, "Controller asked for line %ld but lines are not numbered", number);
+    else if (number <= answered_number || (number == last_resend && stale_requests > 0))
+        stale_requests -= stale_requests > 0; // Already served
+    else
+        resend_from = number;
+}
+
+// Pick the link by name: serial, tcp, file, null or console
+int SelectTransport(const char *name)
+{
+    const Transport *found = FindTransport(name);
 
-        if (n > 0)
+    if (!found)
+        return (-1);
+    transport = found;
+    return (0);
+}
+
+const char *TransportName(void)
+{
+    return transport->name;
+}
+
+// RTS/CTS handshaking, for controllers that drive CTS. Takes effect when the port opens.
+void SetHardwareFlow(int enabled)
+{
+    hardware_flow = enabled;
+}
+
+// Whether the link throttles the sender itself, so commands need not wait for room in the controller
+int HardwareFlow(void)
+{
+    return hardware_flow && transport == &serial_transport;
+}
+
+// Commands go out as N<n> ... *<checksum>, for controllers that check them and ask for damaged lines again
+void SetLineNumbers(int enabled)
+{
+    line_numbers = enabled;
+}
+
+// Bytes numbering adds to the next command at most, "N<n> " before it and "*<checksum>" after it
+int LineOverhead(void)
+{
+    char digits[24];
+
+    if (!line_numbers)
+        return 0;
+    return snprintf(digits, sizeof(digits), "%ld", next_number) + 6;
+}
+
+// Open port with checking
+int CanRS232PortBeOpened(void)
+{
+    if (transport->open(transport_target))
+        return (-1);
+    pending_acks = 0;
+
+#ifdef AUTO_BAUD
+    if (transport == &serial_transport)
+        NegotiateBaudRate();
+#endif
+
+    // Probing reads the port directly, replies are counted from here on
+    ReplyInit(&replies);
+    unclaimed_acks = unclaimed_errors = banner_seen = 0;
+
+    return (0); // Success
+}
+
+int CurrentBaudRate(void)
+{
+    return active_bdrate;
+}
+
+// Device, host:port or file for the transport, e.g. a pty played back by the replay tool
+int SetSerialDevice(const char *device)
+{
+    if (strlen(device) >= 64)
+        return (-1);
+    transport_target = device;
+    return (0);
+}
+
+// Where the remembered rates live, the same file whatever directory the tool runs from
+int SetBaudCacheFile(const char *filename)
+{
+    if (strlen(filename) >= 256)
+        return (-1);
+    baud_cache_file = filename;
+    return (0);
+}
+
+static const char *BaudCachePath(void)
+{
+    static char path[512];
+#ifdef _WIN32
+    const char *home = getenv("APPDATA");
+#else
+    const char *home = getenv("HOME");
+#endif
+
+    if (baud_cache_file)
+        return baud_cache_file[0] ? baud_cache_file : NULL; // An empty name turns the cache off
+    if (!home || snprintf(path, sizeof(path), "%s/%s", home, BAUD_CACHE_FILE) >= (int)sizeof(path))
+        return NULL; // No home directory, rates are probed every time
+    return path;
+}
+
+// Look up the rate that last worked for this device, 0 if there is none
+static int LoadCachedBaudRate(const char *device)
+{
+    char name[64];
+    int rate;
+    const char *path = BaudCachePath();
+    FILE *file = path ? fopen(path, "r") : NULL;
+
+    if (!file)
+        return 0;
+
+    while (fscanf(file, "%63s %d", name, &rate) == 2)
+    {
+        if (!strcmp(name, device))
         {
-            printf("RCVD: N = %d ", n);
-            buf[n] = 0; /* always put a "null" at the end of a string! */
+            fclose(file);
+            return rate;
+        }
+    }
 
-            for (i = 0; i < n; i++)
-            {
-                if (buf[i] == '$') /* replace unreadable control-codes by dots */
-                {
-                    printf("received %i bytes: %s \n", n, (char *)buf);
-                    printf("\nSaw the Dollar");
-                    return 0;
-                }
-            }
+    fclose(file);
+    return 0;
+}
 
-            printf("received %i bytes: %s \n", n, (char *)buf);
+// Store the working rate for this device, keeping the entries of other devices
+static void SaveCachedBaudRate(const char *device, int rate)
+{
+    char names[16][64];
+    int rates[16];
+    int count = 0, i;
+    const char *path = BaudCachePath();
+    FILE *file;
 
-            if ((buf[0] == 'o') && (buf[1] == 'k'))
-                return 0;
+    if (!path)
+        return;
+    file = fopen(path, "r");
+
+    if (file)
+    {
+        while (count < 16 && fscanf(file, "%63s %d", names[count], &rates[count]) == 2)
+        {
+            if (strcmp(names[count], device))
+                count++;
         }
+        fclose(file);
+    }
 
-        Sleep(100);
+    file = fopen(path, "w");
+    if (!file)
+    {
+        LogPrintf(LOG_WARN, "Unable to write %s", path);
+        return;
     }
 
-    return (0);
+    for (i = 0; i < count; i++)
+        fprintf(file, "%s %d\n", names[i], rates[i]);
+    fprintf(file, "%s %d\n", device, rate);
+    fclose(file);
 }
 
-int WaitForReply(void)
+// A reply only counts if it holds a complete, printable status report
+static int IsCleanStatusReply(const unsigned char *buf, int n)
 {
+    int i, start = -1;
 
-    int i, n;
+    for (i = 0; i < n; i++)
+    {
+        if (buf[i] == '<')
+        {
+            start = i;
+        }
+        else if (buf[i] == '>' && start >= 0)
+        {
+            return (i - start > 1);
+        }
+        else if (start >= 0 && (buf[i] < 32 || buf[i] > 126))
+        {
+            start = -1; // Line noise inside the report
+        }
+    }
+
+    return 0;
+}
 
-    unsigned char buf[4096];
+// Check that the controller answers status queries cleanly at the current rate
+static int ProbeCurrentRate(int first_timeout)
+{
+    unsigned char buf[256];
+    int round, n, len;
+    long long deadline;
 
-    while (1)
+    for (round = 0; round < BAUD_PROBE_ROUNDS; round++)
     {
-        printf(".");
-        n = RS232_PollComport(cport_nr, buf, 4095);
+        RS232_Flush(SerialPort(), RS232_FLUSH_RX);
+        WritePortByte('?');
 
-        if (n > 0)
-        {
-            printf("RCVD: N = %d ", n);
-            buf[n] = 0; /* always put a "null" at the end of a string! */
+        len = 0;
+        deadline = TimerMillis() + (round ? BAUD_PROBE_TIMEOUT : first_timeout);
 
-            for (i = 0; i < n; i++)
+        while (1)
+        {
+            n = ReadPort(buf + len, (int)sizeof(buf) - 1 - len);
+            if (n > 0)
             {
-                if (buf[i] < 32) /* replace unreadable control-codes by dots */
+                len += n;
+                buf[len] = 0;
+
+                if (IsCleanStatusReply(buf, len))
+                    break;
+
+                // A fresh banner means the query went to a controller that was still booting
+                if (strstr((char *)buf, "Grbl"))
+                {
+                    WritePortByte('?');
+                    len = 0;
+                }
+                else if (len >= (int)sizeof(buf) - 1)
                 {
-                    buf[i] = '.';
+                    return 0; // Garbage without a report, wrong rate
                 }
             }
 
-            printf("received %i bytes: %s\n", n, (char *)buf);
-
-            if ((buf[0] == 'o') && (buf[1] == 'k'))
+            if (TimerMillis() > deadline)
                 return 0;
+
+            Sleep(5);
         }
+    }
+
+    return 1;
+}
 
-        Sleep(100);
+#ifdef BAUD_SWITCH_FORMAT
+
+// Ask the controller to move to faster rates, returns the rate both ends settled on
+static int UpgradeBaudRate(int rate)
+{
+    char command[64];
+    int i;
+
+    for (i = 0; i < BAUD_CANDIDATE_COUNT && baud_candidates[i] > rate; i++)
+    {
+        sprintf(command, BAUD_SWITCH_FORMAT, baud_candidates[i]);
+        WritePort(command);
+        Sleep(BAUD_SWITCH_SETTLE);
+
+        if (!RS232_SetPortBaudrate(SerialPort(), baud_candidates[i]) && ProbeCurrentRate(BAUD_PROBE_TIMEOUT))
+            return baud_candidates[i];
+
+        // The controller may have switched but the link is unstable, ask it back
+        sprintf(command, BAUD_SWITCH_FORMAT, rate);
+        WritePort(command);
+        Sleep(BAUD_SWITCH_SETTLE);
+        RS232_SetPortBaudrate(SerialPort(), rate);
+
+        if (!ProbeCurrentRate(BAUD_PROBE_TIMEOUT))
+            return 0; // Lost the controller, caller rescans
     }
 
-    return (0);
+    return rate;
 }
 
-// Error was here - this should be 'ELSE' not 'ELSEIF'
+#endif
 
-#else
+// Try each rate in turn, returns the first one the controller answers at or 0
+static int ScanBaudRates(const int *order, int count)
+{
+    int i;
 
-// Open port with checking
-int CanRS232PortBeOpened(void)
+    for (i = 0; i < count; i++)
+    {
+        if (RS232_SetPortBaudrate(SerialPort(), order[i]))
+            continue;
+        if (ProbeCurrentRate(i ? BAUD_PROBE_TIMEOUT : BAUD_BOOT_TIMEOUT))
+            return order[i];
+    }
+
+    return 0;
+}
+
+// Find the fastest rate the controller answers at, remembered per device
+int NegotiateBaudRate(void)
 {
-    return (0); // Success
+    if (transport != &serial_transport)
+        return active_bdrate; // Only a serial line has a rate to find
+
+    const char *device = RS232_PortDevice(SerialPort());
+    int order[BAUD_CANDIDATE_COUNT + 2];
+    int count = 0, found, i;
+    int cached = LoadCachedBaudRate(device);
+
+    // The remembered rate first, then the default the controller boots at. Only then the
+    // others, slower rates working down from the default before faster ones working up, so
+    // a controller left at a slow rate is not sent a run of garbage first.
+    if (cached)
+        order[count++] = cached;
+    if (cached != bdrate)
+        order[count++] = bdrate;
+    for (i = 0; i < BAUD_CANDIDATE_COUNT; i++)
+    {
+        if (baud_candidates[i] < bdrate && baud_candidates[i] != cached)
+            order[count++] = baud_candidates[i];
+    }
+    for (i = BAUD_CANDIDATE_COUNT - 1; i >= 0; i--)
+    {
+        if (baud_candidates[i] > bdrate && baud_candidates[i] != cached)
+            order[count++] = baud_candidates[i];
+    }
+
+    found = ScanBaudRates(order, count);
+
+#ifdef BAUD_SWITCH_FORMAT
+    if (found)
+    {
+        int upgraded = UpgradeBaudRate(found);
+        found = upgraded ? upgraded : ScanBaudRates(order, count);
+    }
+#endif
+
+    if (!found)
+    {
+        LogPrintf(LOG_WARN, "No status reply while probing, staying at %d baud", bdrate);
+        RS232_SetPortBaudrate(SerialPort(), bdrate);
+        active_bdrate = bdrate;
+        return active_bdrate;
+    }
+
+    if (found != cached)
+        SaveCachedBaudRate(device, found);
+
+    active_bdrate = found;
+    LogPrintf(LOG_INFO, "Link running at %d baud", active_bdrate);
+    return active_bdrate;
 }
 
 // Function to close the COM port
 void CloseRS232Port(void)
 {
-    return;
+    if (resent_lines)
+        LogPrintf(LOG_INFO, "%ld lines sent again on request", resent_lines);
+    transport->close();
 }
 
-// JIB: you MUST specify variable types in function definitions
+// Write text out via the serial port
 int PrintBuffer(char *buffer)
 {
-    printf("%s \n", buffer);
+    if (line_numbers ? SendNumberedText(buffer, (int)strlen(buffer)) : WritePort(buffer))
+        return (-1);
+    LogBytes(LOG_DEBUG, "sent", buffer, (int)strlen(buffer));
+
     return (0);
 }
 
+// Send a single real-time byte such as '?', safe to interleave with a command being written
+int SendRealtime(char command)
+{
+    if (transport->acknowledges)
+        return (1); // No controller to query
+    return WritePortByte((unsigned char)command);
+}
+
+// TimerMillis() of the last time anything read the replies, status reports are only parsed then
+long long LastReceiveTime(void)
+{
+    return atomic_load(&last_receive);
+}
+
+// Read whatever has arrived and act on every complete line, -1 once the link is gone
+static int ReceiveReplies(void)
+{
+    ReplyLine line;
+    int size, n;
+    unsigned char *space = ReplySpace(&replies, &size);
+
+    atomic_store(&last_receive, TimerMillis());
+
+    // The port reads straight into the parser's ring
+    n = ReadPort(space, size);
+    if (n < 0)
+    {
+        LogPrintf(LOG_ERROR, "Connection to the controller lost");
+        return (-1);
+    }
+    if (n > 0)
+    {
+        // Formatting happens on the log thread, the terminal never slows the link
+        LogBytes(LOG_DEBUG, "received", space, n);
+        ReplyCommit(&replies, n);
+    }
+
+    while (ReplyNext(&replies, &line))
+    {
+        if (line.kind != REPLY_STATUS)
+            last_answer = TimerMillis(); // Status reports come whether lines get through or not
+        switch (line.kind)
+        {
+        case REPLY_OK:
+            CountOk();
+            break;
+        case REPLY_ERROR:
+            unclaimed_acks++; // Grbl answers every line with exactly one ok or error
+            unclaimed_errors++;
+            answered_number++;
+            unanswered--;
+            if (line_numbers && next_number - answered_number <= LINE_HISTORY && answered_number < next_number)
+            {
+                int slot = (int)(answered_number & (LINE_HISTORY - 1));
+                LogPrintf(LOG_WARN, "Controller replied %.*s to %.*s", line.length, line.text,
+                          history_length[slot] - 1, history[slot]);
+            }
+            else
+                LogPrintf(LOG_WARN, "Controller replied %.*s", line.length, line.text);
+            break;
+        case REPLY_RESEND:
+            RequestResend(line.code);
+            break;
+        case REPLY_STATUS:
+            if (!ParseStatusReport(line.text, line.length))
+                status_seen = 1;
+            break;
+        case REPLY_ALARM:
+            LogPrintf(LOG_ERROR, "Controller raised %.*s", line.length, line.text);
+            break;
+        case REPLY_BANNER:
+            banner_seen = 1;
+            LogPrintf(LOG_INFO, "Controller: %.*s", line.length, line.text);
+            break;
+        default:
+            if (line_numbers && line.length == 2 && unanswered > 0)
+            {
+                // Noise hit an ok, the line it answers is still done
+                LogPrintf(LOG_WARN, "Damaged reply %.*s taken as ok", line.length, line.text);
+                CountOk();
+            }
+            else if (line.length)
+                LogPrintf(LOG_INFO, "Controller: %.*s", line.length, line.text);
+            break;
+        }
+    }
+
+    // A lost request or a line the noise merged into another leaves lines without a reply,
+    // ask for them again rather than stall
+    if (line_numbers && unanswered > 0 && resend_from < 0 && TimerMillis() - last_answer > LINE_REPLY_TIMEOUT)
+    {
+        last_answer = TimerMillis();
+        if (answered_number + 1 < next_number)
+        {
+            LogPrintf(LOG_WARN, "No reply for %d ms", LINE_REPLY_TIMEOUT);
+            resend_from = answered_number + 1;
+            stale_requests = 0;
+        }
+        else
+            unanswered = 0; // Every line was answered after all
+    }
+
+    if (resend_from >= 0 && ResendLines())
+        return (-1);
+    return n;
+}
+
+// Read replies until *flag is set, -1 if the link drops or timeout ms pass first
+static int WaitForFlag(const int *flag, int timeout)
+{
+    long long deadline = TimerMillis() + timeout;
+
+    while (!*flag)
+    {
+        int n = ReceiveReplies();
+        if (n < 0)
+            return (-1);
+        if (TimerMillis() > deadline)
+            return (-1);
+        if (!n && !ReadWaits())
+            Sleep(1);
+    }
+    return (0);
+}
+
+// Bring the controller to a known state: drop stale input, soft reset it with Ctrl-X,
+// wait for the banner it prints on restart and check that it answers a status query.
+// Every step ends as soon as the reply arrives, so a reconnect takes milliseconds.
+int ConnectController(void)
+{
+    unsigned char scratch[256];
+    long long span = TraceBegin();
+
+    if (transport->acknowledges)
+        return StartLineNumbers(); // Nothing on the other end to reset
+
+    // Whatever arrived before now belongs to an earlier session
+    if (transport == &serial_transport)
+        RS232_Flush(SerialPort(), RS232_FLUSH_RX | RS232_FLUSH_TX);
+    else
+    {
+        while (ReadPort(scratch, (int)sizeof(scratch)) > 0)
+            ;
+    }
+    ReplyInit(&replies);
+    unclaimed_acks = unclaimed_errors = banner_seen = status_seen = 0;
+
+    if (WritePortByte(CONNECT_RESET))
+        return (-1);
+    if (WaitForFlag(&banner_seen, CONNECT_BANNER_TIMEOUT))
+    {
+        LogPrintf(LOG_ERROR, "No banner within %d ms of the reset", CONNECT_BANNER_TIMEOUT);
+        return (-1);
+    }
+
+    // The reset also dropped anything queued, only replies from here on count
+    unclaimed_acks = unclaimed_errors = 0;
+
+    if (WritePortByte('?') || WaitForFlag(&status_seen, CONNECT_STATUS_TIMEOUT))
+    {
+        LogPrintf(LOG_ERROR, "No status report within %d ms of the banner", CONNECT_STATUS_TIMEOUT);
+        return (-1);
+    }
+
+    StatusSnapshot status;
+    ReadStatusSnapshot(&status);
+    if (status.state == MACHINE_ALARM)
+        LogPrintf(LOG_WARN, "Controller is in alarm, unlock it with $X or home it with $H");
+    if (StartLineNumbers())
+        return (-1);
+    LogPrintf(LOG_DEBUG, "Controller ready, %s", MachineStateName(status.state));
+    TraceEnd("serial", "ConnectController", span, NULL, 0);
+    return (0);
+}
+
+// Wait for the reply to one command. Replies that arrived together are kept for the next calls.
 int WaitForReply(void)
 {
-    char c;
-    c = getchar();
+    long long span = TraceBegin();
+
+    while (!unclaimed_acks)
+    {
+        int n = ReceiveReplies();
+        if (n < 0)
+            return (-1);
+        if (!n && !ReadWaits())
+            Sleep(1);
+    }
+
+    unclaimed_acks--;
+    unclaimed_errors = 0; // Already logged, a blocking sender has no use for the count
+    TraceEnd("serial", "WaitForReply", span, NULL, 0);
     return (0);
 }
 
-int WaitForDollar(void)
+// Write one command without waiting for its reply, the caller does the flow control
+int SendLine(const char *line, int length)
 {
-    char c;
-    c = getchar();
+    if (line_numbers ? SendNumberedText(line, length) : WriteBytes((const unsigned char *)line, length))
+        return (-1);
+    LogBytes(LOG_DEBUG, "sent", line, length);
+
     return (0);
 }
 
-#endif // SM
+// Number of commands acknowledged since the last call, never blocks
+int PollReplies(int *errors)
+{
+    int acks;
+
+    // One read, a second one would wait again on a link whose reads wait for data
+    if (ReceiveReplies() < 0)
+        return (-1);
+
+    acks = unclaimed_acks;
+    if (errors)
+        *errors += unclaimed_errors;
+    unclaimed_acks = unclaimed_errors = 0;
+    return acks;
+}
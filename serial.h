@@ -4,13 +4,47 @@
 #ifndef SERIAL_H_INCLUDED
 #define SERIAL_H_INCLUDED
 
+#if defined(__linux__) || defined(__FreeBSD__)
+#include <unistd.h>
+#define Sleep(ms) usleep((ms) * 1000) /* Windows Sleep() takes milliseconds */
+#endif
+
 #define cport_nr 5    /* COM number minus 1 */
 #define bdrate 115200 /* 115200  */
 
+#define SERIAL_LOW_LATENCY             /* Reads wait for the first byte of a reply instead of polling */
+#define AUTO_BAUD                      /* Probe for the fastest working rate when the port opens */
+#define BAUD_CACHE_FILE ".writing_robot_baud" /* Remembered rate for each device, in the home directory */
+#define BAUD_BOOT_TIMEOUT 2500         /* ms to wait for the first reply, the controller may be resetting */
+#define BAUD_PROBE_TIMEOUT 250         /* ms to wait for each later status reply */
+#define BAUD_PROBE_ROUNDS 3            /* Clean replies in a row before a rate is accepted */
+#define BAUD_SWITCH_SETTLE 50          /* ms for a rate change command to drain at the old rate */
+// #define BAUD_SWITCH_FORMAT "M575 P0 B%d\n" /* Controller command to change its rate, if it has one */
+#define CONNECT_RESET 0x18             /* Ctrl-X, Grbl's soft reset */
+#define CONNECT_BANNER_TIMEOUT 2000    /* ms from the reset to the welcome banner */
+#define CONNECT_STATUS_TIMEOUT 500     /* ms from the status query to the report */
+#define LINE_HISTORY 512               /* Numbered lines kept for resend requests, a power of two above STREAM_MAX_IN_FLIGHT */
+#define LINE_FRAMED_SIZE 288           /* Longest numbered line, "N<n> " and "*<checksum>" included */
+#define LINE_REPLY_TIMEOUT 2000        /* ms of silence with numbered lines unanswered before they are sent again */
+
 int PrintBuffer(char *buffer);  // JIB: Needed to match the function
 int WaitForReply(void);         // Wit for OK function
-int WaitForDollar(void);        // Wait for '$' function (for startup)
+int ConnectController(void);    // Reset the controller and wait until it is ready (for startup)
 int CanRS232PortBeOpened(void); // Port open check
 void CloseRS232Port(void);
+int NegotiateBaudRate(void);             // Settle on the fastest rate the link handles
+int CurrentBaudRate(void);               // Rate the port is running at
+int SendRealtime(char command);          // Send a single real-time byte such as '?'
+long long LastReceiveTime(void);         // TimerMillis() of the last read for replies
+int SetSerialDevice(const char *device); // Device, host:port or file of the transport
+int SetBaudCacheFile(const char *filename); // Remember probed rates here instead of the home directory, "" for nowhere
+int SelectTransport(const char *name);   // serial, tcp, file, null or console, -1 if unknown
+const char *TransportName(void);         // Transport in use
+void SetHardwareFlow(int enabled);       // Open the serial port with RTS/CTS handshaking
+int HardwareFlow(void);                  // 1 if the serial link throttles itself with RTS/CTS
+int SendLine(const char *line, int length); // Write a command without waiting for the reply
+int PollReplies(int *errors);            // Commands acknowledged since the last call, adds error replies to *errors
+void SetLineNumbers(int enabled);        // Send commands as N<n> ... *<checksum> and answer resend requests
+int LineOverhead(void);                  // Most bytes numbering adds to a command
 
 #endif // SERIAL_H_INCLUDED
@@ -0,0 +1,207 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "status.h"
+#include "serial.h"
+#include "timer.h"
+#include "log.h"
+
+// The snapshot is guarded by a sequence lock: the single writer (the thread reading the
+// port) makes the sequence odd while it updates, readers retry until they see the same
+// even value before and after their copy. Neither side ever blocks the other.
+// The snapshot is kept as relaxed atomic words, so a copy that overlaps an update is a
+// torn read the sequence check discards rather than a data race.
+#define SNAPSHOT_WORDS ((sizeof(StatusSnapshot) + sizeof(unsigned long long) - 1) / sizeof(unsigned long long))
+
+static atomic_uint snapshot_sequence;
+static atomic_ullong snapshot[SNAPSHOT_WORDS];
+static unsigned long report_count; // Only the writer touches this
+
+static pthread_t poller_thread;
+static atomic_int poller_running;
+
+static const char *state_names[] = {"Unknown", "Idle", "Run", "Hold", "Jog", "Alarm", "Door", "Check", "Home", "Sleep"};
+
+const char *MachineStateName(MachineState state)
+{
+    return state_names[state];
+}
+
+// Match the state word at the start of a report, "Hold:0" and "Door:1" carry sub-states
+static MachineState ParseMachineState(const char *text)
+{
+    int i;
+
+    for (i = MACHINE_IDLE; i <= MACHINE_SLEEP; i++)
+    {
+        if (!strncmp(text, state_names[i], strlen(state_names[i])))
+            return (MachineState)i;
+    }
+    return MACHINE_UNKNOWN;
+}
+
+// Parse both Grbl 1.1 "<Run|MPos:1,2,3|Bf:15,128>" and 0.9 "<Run,MPos:1,2,3,Buf:0,RX:0>" reports
+int ParseStatusReport(const char *report, int length)
+{
+    char text[256];
+    const char *field;
+    StatusSnapshot next;
+    int used;
+
+    if (length < 3 || length >= (int)sizeof(text) || report[0] != '<' || report[length - 1] != '>')
+        return (-1);
+
+    memcpy(text, report + 1, length - 2);
+    text[length - 2] = 0;
+
+    memset(&next, 0, sizeof(next));
+    next.state = ParseMachineState(text);
+    next.planner_free = -1;
+    next.rx_free = -1;
+
+    if ((field = strstr(text, "MPos:")) || (field = strstr(text, "WPos:")))
+        sscanf(field + 5, "%f,%f,%f", &next.x, &next.y, &next.z);
+
+    if ((field = strstr(text, "Bf:")))
+    {
+        sscanf(field + 3, "%d,%d", &next.planner_free, &next.rx_free);
+    }
+    else
+    {
+        if ((field = strstr(text, "Buf:")) && sscanf(field + 4, "%d", &used) == 1)
+            next.planner_free = STATUS_PLANNER_SIZE - used;
+        if ((field = strstr(text, "RX:")) && sscanf(field + 3, "%d", &used) == 1)
+            next.rx_free = STATUS_RX_SIZE - used;
+    }
+
+    next.timestamp = TimerMillis();
+
+    next.reports = ++report_count;
+
+    unsigned long long words[SNAPSHOT_WORDS] = {0};
+    unsigned int sequence = atomic_load_explicit(&snapshot_sequence, memory_order_relaxed);
+    memcpy(words, &next, sizeof(next));
+    atomic_store_explicit(&snapshot_sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    for (size_t i = 0; i < SNAPSHOT_WORDS; i++)
+        atomic_store_explicit(&snapshot[i], words[i], memory_order_relaxed);
+    atomic_store_explicit(&snapshot_sequence, sequence + 2, memory_order_release);
+
+    return (0);
+}
+
+int ReadStatusSnapshot(StatusSnapshot *copy)
+{
+    unsigned long long words[SNAPSHOT_WORDS];
+    unsigned int before, after;
+
+    do
+    {
+        before = atomic_load_explicit(&snapshot_sequence, memory_order_acquire);
+        for (size_t i = 0; i < SNAPSHOT_WORDS; i++)
+            words[i] = atomic_load_explicit(&snapshot[i], memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+        after = atomic_load_explicit(&snapshot_sequence, memory_order_relaxed);
+    } while ((before & 1) || before != after);
+
+    memcpy(copy, words, sizeof(*copy));
+    return copy->reports != 0;
+}
+
+// Send '?' at a fixed interval and watch the replies for a machine that stopped moving.
+// '?' is a real-time command, Grbl picks it out of the stream even in the middle of a line.
+// Reports are parsed by whoever reads the replies, so while nobody does (the job is being
+// generated, the pipe is idle) the poller stops asking and the stall checks start over.
+static void *StatusPollerMain(void *unused)
+{
+    StatusSnapshot current;
+    float last_x = 0, last_y = 0;
+    long long moved_at = TimerMillis(), heard_from = moved_at;
+    int stalled = 0, silent = 0, reading = 0;
+
+    (void)unused;
+
+    while (atomic_load(&poller_running))
+    {
+        long long now = TimerMillis();
+        if (now - LastReceiveTime() > STATUS_POLL_MS)
+        {
+            reading = 0;
+            Sleep(STATUS_POLL_MS);
+            continue;
+        }
+        if (!reading)
+        {
+            reading = 1;
+            moved_at = heard_from = now;
+            stalled = silent = 0;
+        }
+
+        SendRealtime('?');
+        Sleep(STATUS_POLL_MS);
+
+        now = TimerMillis();
+        if (!ReadStatusSnapshot(&current))
+            continue;
+        if (current.timestamp > heard_from)
+            heard_from = current.timestamp;
+
+        if (current.state != MACHINE_RUN || current.x != last_x || current.y != last_y)
+        {
+            last_x = current.x;
+            last_y = current.y;
+            moved_at = now;
+            stalled = 0;
+        }
+        else if (!stalled && now - moved_at > STATUS_STALL_MS)
+        {
+            LogPrintf(LOG_WARN, "Stall: Run at X%.2f Y%.2f for %lld ms, planner free %d, RX free %d",
+                   current.x, current.y, now - moved_at, current.planner_free, current.rx_free);
+            stalled = 1;
+        }
+
+        if (now - heard_from > STATUS_STALL_MS)
+        {
+            if (!silent)
+                LogPrintf(LOG_WARN, "Stall: no status report for %lld ms", now - heard_from);
+            silent = 1;
+        }
+        else
+        {
+            silent = 0;
+        }
+    }
+
+    return NULL;
+}
+
+int StartStatusPoller(void)
+{
+    if (atomic_exchange(&poller_running, 1))
+        return (0); // Already running
+
+    if (SendRealtime('?'))
+    {
+        atomic_store(&poller_running, 0);
+        return (-1); // No controller that answers status queries
+    }
+
+    if (pthread_create(&poller_thread, NULL, StatusPollerMain, NULL))
+    {
+        atomic_store(&poller_running, 0);
+        LogPrintf(LOG_ERROR, "Unable to start the status poller");
+        return (-1);
+    }
+    return (0);
+}
+
+void StopStatusPoller(void)
+{
+    if (!atomic_exchange(&poller_running, 0))
+        return;
+
+    pthread_join(poller_thread, NULL);
+}
@@ -0,0 +1,40 @@
+#ifndef STATUS_H_INCLUDED
+#define STATUS_H_INCLUDED
+
+#define STATUS_POLL_MS 200   /* Interval between '?' status queries */
+#define STATUS_STALL_MS 2000 /* Warn when a running machine has not moved for this long */
+#define STATUS_PLANNER_SIZE 15 /* Planner blocks, used to convert Grbl 0.9 "Buf:" fill to free */
+#define STATUS_RX_SIZE 128     /* Serial RX buffer, used to convert Grbl 0.9 "RX:" fill to free */
+
+typedef enum
+{
+    MACHINE_UNKNOWN,
+    MACHINE_IDLE,
+    MACHINE_RUN,
+    MACHINE_HOLD,
+    MACHINE_JOG,
+    MACHINE_ALARM,
+    MACHINE_DOOR,
+    MACHINE_CHECK,
+    MACHINE_HOME,
+    MACHINE_SLEEP
+} MachineState;
+
+// Latest status report from the controller
+typedef struct
+{
+    MachineState state;
+    float x, y, z;         // Machine position (work position if that is all the controller reports)
+    int planner_free;      // Free planner blocks, -1 if not reported
+    int rx_free;           // Free bytes in the controller's serial buffer, -1 if not reported
+    long long timestamp;   // TimerMillis() when the report arrived
+    unsigned long reports; // Number of reports parsed so far
+} StatusSnapshot;
+
+int StartStatusPoller(void);                          // Start the background '?' poller
+void StopStatusPoller(void);                          // Stop it and wait for the thread to exit
+int ParseStatusReport(const char *report, int length); // Publish a "<...>" report, 0 on success
+int ReadStatusSnapshot(StatusSnapshot *snapshot);      // Copy the latest report, 0 if none yet
+const char *MachineStateName(MachineState state);
+
+#endif // STATUS_H_INCLUDED
@@ -0,0 +1,324 @@
+#define _FILE_OFFSET_BITS 64 /* Files past 2 GB on 32-bit systems */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "stream.h"
+#include "serial.h"
+#include "status.h"
+#include "timer.h"
+#include "log.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// A window of a file mapped into memory. Only STREAM_WINDOW bytes are mapped at a time,
+// so files far larger than memory (or the address space) stream the same way.
+typedef struct
+{
+#ifdef _WIN32
+    HANDLE file, mapping;
+#else
+    int fd;
+#endif
+    long long size;
+    long long granularity; // Mapping offsets must be a multiple of this
+    const char *view;
+    long long view_offset, view_length;
+} GcodeMap;
+
+static void map_release(GcodeMap *map)
+{
+    if (!map->view)
+        return;
+#ifdef _WIN32
+    UnmapViewOfFile(map->view);
+#else
+    munmap((void *)map->view, map->view_length);
+#endif
+    map->view = NULL;
+}
+
+static int map_open(GcodeMap *map, const char *filename)
+{
+    memset(map, 0, sizeof(*map));
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    LARGE_INTEGER size;
+
+    map->file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                            FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (map->file == INVALID_HANDLE_VALUE || !GetFileSizeEx(map->file, &size))
+        return -1;
+    map->size = size.QuadPart;
+    map->mapping = map->size ? CreateFileMappingA(map->file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+    if (map->size && !map->mapping)
+    {
+        CloseHandle(map->file);
+        return -1;
+    }
+    GetSystemInfo(&info);
+    map->granularity = info.dwAllocationGranularity;
+#else
+    struct stat info;
+
+    map->fd = open(filename, O_RDONLY);
+    if (map->fd == -1)
+        return -1;
+    if (fstat(map->fd, &info))
+    {
+        close(map->fd);
+        return -1;
+    }
+    map->size = info.st_size;
+    map->granularity = sysconf(_SC_PAGESIZE);
+#endif
+    return 0;
+}
+
+// Map the window that starts at (or just before) offset
+static int map_window(GcodeMap *map, long long offset)
+{
+    long long start = offset - offset % map->granularity;
+    long long length = map->size - start < STREAM_WINDOW ? map->size - start : STREAM_WINDOW;
+
+    map_release(map);
+#ifdef _WIN32
+    map->view = MapViewOfFile(map->mapping, FILE_MAP_READ, (DWORD)(start >> 32), (DWORD)start, (SIZE_T)length);
+    if (!map->view)
+        return -1;
+#else
+    void *view = mmap(NULL, length, PROT_READ, MAP_PRIVATE, map->fd, start);
+    if (view == MAP_FAILED)
+        return -1;
+#ifdef MADV_SEQUENTIAL
+    madvise(view, length, MADV_SEQUENTIAL); // Read ahead, and let the kernel drop pages behind us
+#endif
+    map->view = view;
+#endif
+    map->view_offset = start;
+    map->view_length = length;
+    return 0;
+}
+
+static void map_close(GcodeMap *map)
+{
+    map_release(map);
+#ifdef _WIN32
+    if (map->mapping)
+        CloseHandle(map->mapping);
+    CloseHandle(map->file);
+#else
+    close(map->fd);
+#endif
+}
+
+// The raw line at *position, which moves past it. NULL at the end of the file.
+static const char *next_line(GcodeMap *map, long long *position, long long *length)
+{
+    long long window_end = map->view_offset + map->view_length;
+
+    if (*position >= map->size)
+        return NULL;
+    if (!map->view || *position >= window_end)
+    {
+        if (map_window(map, *position))
+            return NULL;
+        window_end = map->view_offset + map->view_length;
+    }
+
+    const char *start = map->view + (*position - map->view_offset);
+    const char *newline = memchr(start, '\n', window_end - *position);
+    if (!newline && window_end < map->size)
+    {
+        // The line runs past the window, map again starting at it
+        if (map_window(map, *position))
+            return NULL;
+        window_end = map->view_offset + map->view_length;
+        start = map->view + (*position - map->view_offset);
+        newline = memchr(start, '\n', window_end - *position);
+    }
+
+    *length = newline ? newline - start : window_end - *position;
+    *position += *length + (newline ? 1 : 0);
+    return start;
+}
+
+// Copy a line without comments, surrounding blanks or carriage returns.
+// Length of what is left (0 for nothing to send), -1 if it does not fit in out.
+static int clean_line(const char *line, long long length, char *out)
+{
+    int n = 0, in_comment = 0;
+
+    for (long long i = 0; i < length; i++)
+    {
+        char c = line[i];
+
+        if (in_comment)
+        {
+            in_comment = c != ')';
+            continue;
+        }
+        if (c == '(')
+            in_comment = 1;
+        else if (c == ';')
+            break;
+        else if (c == '\r' || ((c == ' ' || c == '\t') && !n))
+            continue;
+        else if (n == STREAM_LINE_SIZE - 1)
+            return -1; // Room is kept for the newline
+        else
+            out[n++] = c;
+    }
+
+    while (n && (out[n - 1] == ' ' || out[n - 1] == '\t'))
+        n--;
+    if (n == 1 && out[0] == '%') // Program start and end marker
+        n = 0;
+    return n;
+}
+
+static void print_progress(long long position, long long size, long long acked, long long started, int final)
+{
+    double seconds = (TimerMillis() - started) / 1000.0;
+    double percent = size ? 100.0 * position / size : 100.0;
+    long eta = position && !final ? (long)(seconds * (size - position) / position) : 0;
+
+    printf("\rStreamed %5.1f%%, %lld lines, %.0f lines/s, ETA %ld:%02ld  ", percent, acked,
+           seconds > 0 ? acked / seconds : 0.0, eta / 60, eta % 60);
+    if (final)
+        printf("\n");
+    fflush(stdout);
+}
+
+// Lines are sent while they fit in the controller's RX buffer. Every ok or error frees
+// the bytes of the oldest line, so the buffer stays full without ever overflowing.
+// With RTS/CTS the port holds output itself, lines go out back to back and the
+// replies are still counted so errors are seen.
+int stream_gcode_file(const char *filename, FILE *output)
+{
+    GcodeMap map;
+    char line[STREAM_LINE_SIZE];
+    int in_flight[STREAM_MAX_IN_FLIGHT]; // Lengths of the lines the controller has not answered yet
+    int flight_head = 0, flight_count = 0, buffered = 0;
+    int budget = HardwareFlow() ? INT_MAX : STATUS_RX_SIZE; // With RTS/CTS the UART throttles the sender
+    int pending = 0, errors = 0, failed = 0;
+    long long position = 0, sent = 0, acked = 0, skipped = 0, bytes = 0;
+
+    if (map_open(&map, filename))
+    {
+        printf("Error opening file: %s\n", filename);
+        return -1;
+    }
+
+    long long started = TimerMillis(), last_progress = started, last_reply = started;
+    int finished = 0;
+
+    while (1)
+    {
+        // Find the next line with something to send
+        while (!pending && !finished)
+        {
+            long long raw_length;
+            const char *raw = next_line(&map, &position, &raw_length);
+
+            if (!raw)
+            {
+                finished = 1;
+                break;
+            }
+            pending = clean_line(raw, raw_length, line);
+            if (pending < 0 ||
+                pending + 1 + LineOverhead() > (output || HardwareFlow() ? STREAM_LINE_SIZE : STATUS_RX_SIZE))
+            {
+                printf("\nLine %lld is too long to send\n", sent + skipped + 1);
+                failed = 1;
+                break;
+            }
+            if (!pending)
+                skipped++;
+            else
+                line[pending++] = '\n';
+        }
+        if (failed || (!pending && !flight_count))
+            break;
+
+        if (pending && output)
+        {
+            fwrite(line, 1, pending, output);
+            sent++;
+            acked++;
+            bytes += pending;
+            pending = 0;
+            continue;
+        }
+
+        int cost = pending + LineOverhead(); // Bytes the line takes in the controller's buffer
+        if (pending && buffered + cost <= budget && flight_count < STREAM_MAX_IN_FLIGHT)
+        {
+            if (SendLine(line, pending))
+            {
+                failed = 1;
+                break;
+            }
+            in_flight[(flight_head + flight_count++) % STREAM_MAX_IN_FLIGHT] = cost;
+            buffered += cost;
+            bytes += pending;
+            sent++;
+            pending = 0;
+            continue;
+        }
+
+        int acks = PollReplies(&errors);
+        long long now = TimerMillis();
+        if (acks < 0)
+        {
+            failed = 1;
+            break;
+        }
+        if (acks > flight_count)
+        {
+            LogPrintf(LOG_WARN, "%d replies without a command", acks - flight_count);
+            acks = flight_count;
+        }
+        for (; acks; acks--)
+        {
+            buffered -= in_flight[flight_head];
+            flight_head = (flight_head + 1) % STREAM_MAX_IN_FLIGHT;
+            flight_count--;
+            acked++;
+            last_reply = now;
+        }
+
+        if (now - last_reply > STREAM_ACK_TIMEOUT)
+        {
+            printf("\nNo reply from the controller for %d s, %d commands unanswered\n", STREAM_ACK_TIMEOUT / 1000,
+                   flight_count);
+            failed = 1;
+            break;
+        }
+        if (now - last_progress >= STREAM_PROGRESS_MS)
+        {
+            print_progress(position, map.size, acked, started, 0);
+            last_progress = now;
+        }
+        if (last_reply != now)
+            Sleep(1); // Nothing came back, give the controller time to work
+    }
+
+    map_close(&map);
+    print_progress(position, map.size, acked, started, 1);
+
+    double seconds = (TimerMillis() - started) / 1000.0;
+    printf("Streamed %lld commands (%lld bytes) in %.2f s, %lld comment or blank lines skipped, %d error%s\n", sent,
+           bytes, seconds, skipped, errors, errors == 1 ? "" : "s");
+    return failed || errors ? -1 : 0;
+}
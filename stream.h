@@ -0,0 +1,16 @@
+#include <stdio.h>
+
+#ifndef STREAM_H_INCLUDED
+#define STREAM_H_INCLUDED
+
+#define STREAM_WINDOW (64LL << 20) // Bytes of the file mapped at a time
+#define STREAM_LINE_SIZE 256       // Longest command accepted after comments are stripped
+#define STREAM_PROGRESS_MS 500     // Interval between progress updates
+#define STREAM_ACK_TIMEOUT 30000   // ms without a reply before the stream is abandoned
+#define STREAM_MAX_IN_FLIGHT 256   // Unanswered lines with RTS/CTS, their replies must fit in the host tty buffer
+
+// Stream a G-code file to the controller, or to output when it is set.
+// Comments and blank lines are dropped, 0 on success.
+int stream_gcode_file(const char *filename, FILE *output);
+
+#endif // STREAM_H_INCLUDED
@@ -0,0 +1,197 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "capture.h"
+
+#define TEST_TRACE "test_capture.trace" // Written to the working directory and removed again
+
+// Writes a capture with payloads on both sides of every varint length boundary and
+// reads it back, checking direction, length, bytes and that time never runs backwards.
+// The raw bytes of one record are checked against the varint layout, and a trace cut
+// short must end cleanly instead of returning a partial record.
+
+static const int lengths[] = {1, 2, 127, 128, 129, 300, 4095, 4096, 5000, 16384};
+
+#define LENGTH_COUNT (int)(sizeof(lengths) / sizeof(lengths[0]))
+
+static int failures;
+
+static void fill(unsigned char *data, int length, int seed)
+{
+    for (int i = 0; i < length; i++)
+        data[i] = (unsigned char)(i * 31 + seed);
+}
+
+// The records a write of this length becomes, CaptureBytes splits at CAPTURE_MAX_RECORD
+static int expect_records(FILE *file, int direction, int length, int seed, long long *clock, long long *last)
+{
+    static unsigned char expected[16384];
+    static CaptureRecord record;
+    int offset = 0;
+
+    fill(expected, length, seed);
+    while (offset < length)
+    {
+        int chunk = length - offset < CAPTURE_MAX_RECORD ? length - offset : CAPTURE_MAX_RECORD;
+
+        if (!ReadCaptureRecord(file, &record, clock))
+        {
+            printf("FAIL: trace ended before %d bytes at offset %d\n", length, offset);
+            return 1;
+        }
+        if (record.direction != direction || record.length != chunk ||
+            memcmp(record.data, expected + offset, chunk) || record.time < *last)
+        {
+            printf("FAIL: record of %d bytes read back as %d bytes, direction %d, at %lld us\n", chunk,
+                   record.length, record.direction, record.time);
+            return 1;
+        }
+        *last = record.time;
+        offset += chunk;
+    }
+    return 0;
+}
+
+static void test_round_trip(void)
+{
+    static unsigned char data[16384];
+    long long clock = 0, last = 0;
+
+    if (StartCapture(TEST_TRACE))
+    {
+        failures++;
+        return;
+    }
+    for (int i = 0; i < LENGTH_COUNT; i++)
+    {
+        fill(data, lengths[i], i);
+        CaptureBytes(i & 1 ? CAPTURE_RX : CAPTURE_TX, data, lengths[i]);
+    }
+    CaptureBytes(CAPTURE_TX, data, 0); // Nothing to record
+    StopCapture();
+    CaptureBytes(CAPTURE_TX, data, 10); // After the stop, ignored
+
+    FILE *file = fopen(TEST_TRACE, "rb");
+    if (!file || OpenCaptureTrace(file))
+    {
+        printf("FAIL: the trace header does not read back\n");
+        failures++;
+        if (file)
+            fclose(file);
+        return;
+    }
+    for (int i = 0; i < LENGTH_COUNT && !failures; i++)
+        failures += expect_records(file, i & 1 ? CAPTURE_RX : CAPTURE_TX, lengths[i], i, &clock, &last);
+
+    static CaptureRecord record;
+    if (!failures && ReadCaptureRecord(file, &record, &clock))
+    {
+        printf("FAIL: records after the stop or of no bytes were written\n");
+        failures++;
+    }
+    fclose(file);
+}
+
+// One 300 byte write: a time varint with the direction in bit 0, then 300 as 0xAC 0x02
+static void test_layout(void)
+{
+    static unsigned char data[300];
+    unsigned char raw[16];
+
+    if (StartCapture(TEST_TRACE))
+    {
+        failures++;
+        return;
+    }
+    CaptureBytes(CAPTURE_RX, data, sizeof(data));
+    StopCapture();
+
+    FILE *file = fopen(TEST_TRACE, "rb");
+    size_t length = file ? fread(raw, 1, sizeof(raw), file) : 0;
+    size_t magic = strlen(CAPTURE_MAGIC), time = magic;
+
+    while (time < length && raw[time] & 0x80)
+        time++;
+    if (length < time + 3 || memcmp(raw, CAPTURE_MAGIC, magic) || !(raw[magic] & 1) || raw[time + 1] != 0xAC ||
+        raw[time + 2] != 0x02)
+    {
+        printf("FAIL: a 300 byte record is not laid out as varint time and direction, varint length\n");
+        failures++;
+    }
+    if (file)
+        fclose(file);
+}
+
+// Keep only the first bytes of a file, with stdio so the test runs wherever the tools do
+static int cut_file(const char *filename, long bytes)
+{
+    FILE *file = fopen(filename, "rb");
+    char *data = malloc(bytes > 0 ? bytes : 1);
+    int result = -1;
+
+    if (file && data && fread(data, 1, bytes, file) == (size_t)bytes)
+    {
+        fclose(file);
+        file = fopen(filename, "wb");
+        if (file && fwrite(data, 1, bytes, file) == (size_t)bytes)
+            result = 0;
+    }
+    if (file && fclose(file))
+        result = -1;
+    free(data);
+    return result;
+}
+
+// A trace cut inside a payload gives no record for it
+static void test_truncated(void)
+{
+    static unsigned char data[200];
+    static CaptureRecord record;
+    long long clock = 0;
+
+    if (StartCapture(TEST_TRACE))
+    {
+        failures++;
+        return;
+    }
+    CaptureBytes(CAPTURE_TX, data, sizeof(data));
+    StopCapture();
+
+    FILE *file = fopen(TEST_TRACE, "rb");
+    if (!file)
+    {
+        failures++;
+        return;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fclose(file);
+    if (cut_file(TEST_TRACE, size - 50))
+    {
+        failures++;
+        return;
+    }
+
+    file = fopen(TEST_TRACE, "rb");
+    if (!file || OpenCaptureTrace(file) || ReadCaptureRecord(file, &record, &clock))
+    {
+        printf("FAIL: a record cut short was read back\n");
+        failures++;
+    }
+    if (file)
+        fclose(file);
+}
+
+int main(void)
+{
+    test_round_trip();
+    test_layout();
+    test_truncated();
+    remove(TEST_TRACE);
+
+    if (failures)
+        return 1;
+    printf("%d writes read back across varint length boundaries, layout and truncation checked\n", LENGTH_COUNT);
+    return 0;
+}
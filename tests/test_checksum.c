@@ -0,0 +1,192 @@
+#define _GNU_SOURCE /* posix_openpt and ptsname */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "serial.h"
+
+#define TEST_LINES 40  // Numbered commands sent after M110
+#define TEST_DAMAGED 3 // Line that arrives damaged the first time
+#define TEST_BANNER "\r\nGrbl 1.1h ['$' for help]\r\n"
+#define TEST_STATUS "<Idle|MPos:0.000,0.000,0.000|FS:0,0>\r\n"
+
+// Streams numbered lines through serial.c to a Marlin style controller on a pseudo terminal.
+// The controller checks every N<n> ... *<checksum> frame, takes line TEST_DAMAGED as damaged
+// the first time and asks for it again. Every line sent after it is refused with another
+// request for the same line, as Marlin does. The lines must be accepted once each and in
+// order, with line TEST_DAMAGED and those after it sent exactly twice.
+
+static int master;
+static atomic_int running = 1;
+static char accepted[TEST_LINES + 1][64]; // Commands as the controller took them, by number
+static int arrivals[TEST_LINES + 1];      // Frames that arrived for each number
+static int requests;                      // Resend requests the controller made
+static int failures;
+
+static void reply(const char *text)
+{
+    if (write(master, text, strlen(text)) != (ssize_t)strlen(text))
+        failures++;
+}
+
+// One frame, without its newline. Answers ok or a resend request for the line it expects.
+static void take_line(char *line, long *last)
+{
+    char *star = strrchr(line, '*'), *space = strchr(line, ' '), answer[128];
+    unsigned char checksum = 0;
+    long number;
+
+    if (line[0] != 'N' || !star || !space || space > star)
+    {
+        printf("FAIL: unnumbered line %s\n", line);
+        failures++;
+        return;
+    }
+    for (char *p = line; p < star; p++)
+        checksum ^= (unsigned char)*p;
+    number = strtol(line + 1, NULL, 10);
+    if (atoi(star + 1) != checksum)
+    {
+        printf("FAIL: line %s has checksum %d\n", line, checksum);
+        failures++;
+        return;
+    }
+    if (number >= 0 && number <= TEST_LINES)
+        arrivals[number]++;
+
+    if (!strncmp(space + 1, "M110", 4))
+        *last = number;
+    else if (number != *last + 1 || (number == TEST_DAMAGED && arrivals[number] == 1))
+    {
+        requests++;
+        snprintf(answer, sizeof(answer), "Error:%s, Last Line: %ld\r\nResend: %ld\r\nok\r\n",
+                 number == *last + 1 ? "checksum mismatch" : "Line Number is not Last Line Number+1", *last,
+                 *last + 1);
+        reply(answer);
+        return;
+    }
+    else
+    {
+        *last = number;
+        snprintf(accepted[number], sizeof(accepted[number]), "%.*s", (int)(star - space - 1), space + 1);
+    }
+    reply("ok\r\n");
+}
+
+static void *controller(void *unused)
+{
+    char line[256];
+    unsigned char buf[4096];
+    struct pollfd pfd = {master, POLLIN, 0};
+    long last = -1;
+    int length = 0;
+
+    (void)unused;
+    while (atomic_load(&running))
+    {
+        if (poll(&pfd, 1, 50) <= 0 || !(pfd.revents & POLLIN))
+            continue;
+        int n = (int)read(master, buf, sizeof(buf));
+        for (int i = 0; i < n; i++)
+        {
+            if (buf[i] == 0x18)
+                reply(TEST_BANNER);
+            else if (buf[i] == '?')
+                reply(TEST_STATUS);
+            else if (buf[i] == '\n')
+            {
+                line[length] = 0;
+                take_line(line, &last);
+                length = 0;
+            }
+            else if (length < (int)sizeof(line) - 1)
+                line[length++] = (char)buf[i];
+        }
+    }
+    return NULL;
+}
+
+static int open_pty(char *device, size_t size)
+{
+    struct termios settings;
+    int slave;
+
+    master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master == -1 || grantpt(master) || unlockpt(master))
+        return -1;
+    snprintf(device, size, "%s", ptsname(master));
+
+    slave = open(device, O_RDWR | O_NOCTTY);
+    if (slave == -1 || tcgetattr(slave, &settings))
+        return -1;
+    cfmakeraw(&settings);
+    tcsetattr(slave, TCSANOW, &settings);
+    close(slave);
+    return 0;
+}
+
+int main(void)
+{
+    char device[256], command[64];
+    pthread_t thread;
+
+    if (open_pty(device, sizeof(device)))
+    {
+        printf("FAIL: unable to create a pseudo terminal\n");
+        return 1;
+    }
+    pthread_create(&thread, NULL, controller, NULL);
+
+    SetBaudCacheFile("");
+    SetLineNumbers(1);
+    if (SelectTransport("serial") || SetSerialDevice(device) || CanRS232PortBeOpened() || ConnectController())
+    {
+        printf("FAIL: the controller did not accept line numbers\n");
+        failures++;
+    }
+
+    // Every line goes out before any reply is read, so the ones after the damaged line are in flight
+    for (int i = 1; i <= TEST_LINES && !failures; i++)
+    {
+        int length = snprintf(command, sizeof(command), "G1 X%d.%02d Y-%d\n", i, i * 7 % 100, i * 3);
+        if (SendLine(command, length))
+            failures++;
+    }
+    for (int i = 1; i <= TEST_LINES && !failures; i++)
+    {
+        if (WaitForReply())
+            failures++;
+    }
+    CloseRS232Port();
+    atomic_store(&running, 0);
+    pthread_join(thread, NULL);
+    close(master);
+
+    for (int i = 1; i <= TEST_LINES && !failures; i++)
+    {
+        snprintf(command, sizeof(command), "G1 X%d.%02d Y-%d", i, i * 7 % 100, i * 3);
+        if (strcmp(accepted[i], command) || arrivals[i] != (i < TEST_DAMAGED ? 1 : 2))
+        {
+            printf("FAIL: line %d accepted as \"%s\" after %d arrivals\n", i, accepted[i], arrivals[i]);
+            failures++;
+        }
+    }
+    if (!failures && requests != TEST_LINES - TEST_DAMAGED + 1)
+    {
+        printf("FAIL: %d resend requests, expected %d\n", requests, TEST_LINES - TEST_DAMAGED + 1);
+        failures++;
+    }
+
+    if (failures)
+        return 1;
+    printf("%d numbered lines accepted in order, lines %d to %d sent again once after a checksum error\n", TEST_LINES,
+           TEST_DAMAGED, TEST_LINES);
+    return 0;
+}
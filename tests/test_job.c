@@ -0,0 +1,233 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "font.h"
+#include "layout.h"
+#include "generator.h"
+#include "job.h"
+
+#define TEST_JOB "test_job.wrj" // Written to the working directory and removed again
+#define TEST_SCALE 5            // Character height in mm, as the benchmark uses
+
+// Compiles generated G-code into a job file and plays it back. In G-code the playback must
+// give the generated commands byte for byte, in HP-GL it must match what direct generation
+// in HP-GL gives. The header totals are checked against the commands themselves.
+
+static const char *text =
+    "The quick brown fox jumps over the lazy dog. Pack my box with five dozen liquor jugs! "
+    "0123456789 ,.;:?!'\"()-+=/ and a word far too long to fit on any line: "
+    "abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyz";
+
+typedef struct
+{
+    char *text;
+    size_t length, capacity;
+} Output;
+
+static Output played;
+
+static void append(Output *output, const char *text, size_t length)
+{
+    if (output->length + length + 1 > output->capacity)
+    {
+        output->capacity = (output->length + length + 1) * 2;
+        output->text = realloc(output->text, output->capacity);
+        if (!output->text)
+        {
+            printf("Out of memory\n");
+            exit(1);
+        }
+    }
+    memcpy(output->text + output->length, text, length);
+    output->length += length;
+    output->text[output->length] = 0;
+}
+
+static void play_into(const char *text, size_t length)
+{
+    append(&played, text, length);
+}
+
+// The whole text generated in the current dialect, one block per line
+static void generate(Output *output)
+{
+    Document document;
+    char word[100];
+    const char *p = text;
+    int length;
+
+    document_init(&document, TEST_SCALE / CHAR_WIDTH);
+    while (sscanf(p, "%99s%n", word, &length) == 1)
+    {
+        layout_word(&document, word);
+        p += length;
+    }
+
+    CommandBlock *blocks = malloc(document.line_count * sizeof(CommandBlock));
+    for (int i = 0; i < document.line_count; i++)
+        block_init(&blocks[i]);
+    generate_lines(&document, document.line_count, &embedded_font, blocks, NULL);
+    for (int i = 0; i < document.line_count; i++)
+    {
+        append(output, blocks[i].text ? blocks[i].text : "", blocks[i].length);
+        block_free(&blocks[i]);
+    }
+    free(blocks);
+    document_free(&document);
+}
+
+// Totals of the commands, as the writer should have counted them
+static int check_header(const Output *gcode)
+{
+    FILE *file = fopen(TEST_JOB, "rb");
+    JobHeader header;
+    unsigned long long moves = 0, lifts = 0;
+    double x = 0, y = 0, draw = 0, travel = 0;
+    int pen_down = 0;
+
+    if (!file || fread(&header, sizeof(header), 1, file) != 1)
+    {
+        printf("FAIL: the job header does not read back\n");
+        if (file)
+            fclose(file);
+        return 1;
+    }
+    fclose(file);
+
+    for (const char *line = gcode->text; line && *line; line = strchr(line, '\n') + 1)
+    {
+        if (line[0] == 'S')
+        {
+            int down = atoi(line + 1) > 0;
+            lifts += pen_down && !down;
+            pen_down = down;
+        }
+        else if (line[0] == 'G' && (line[1] == '0' || line[1] == '1') && line[2] == ' ')
+        {
+            double nx = x, ny = y;
+            const char *word;
+            if ((word = strchr(line, 'X')) && word < strchr(line, '\n'))
+                nx = strtod(word + 1, NULL);
+            if ((word = strchr(line, 'Y')) && word < strchr(line, '\n'))
+                ny = strtod(word + 1, NULL);
+            *(pen_down ? &draw : &travel) += hypot(nx - x, ny - y);
+            x = nx;
+            y = ny;
+            moves++;
+        }
+    }
+
+    if (memcmp(header.magic, JOB_MAGIC, sizeof(header.magic)) || header.version != JOB_VERSION ||
+        header.moves != moves || header.pen_lifts != lifts || fabs(header.draw_mm - draw) > 0.01 ||
+        fabs(header.travel_mm - travel) > 0.01 || !header.runs || header.seconds <= 0)
+    {
+        printf("FAIL: header has %llu moves, %llu lifts, %.2f mm drawn, %.2f mm travelled, "
+               "the commands %llu, %llu, %.2f, %.2f\n",
+               (unsigned long long)header.moves, (unsigned long long)header.pen_lifts, header.draw_mm,
+               header.travel_mm, moves, lifts, draw, travel);
+        return 1;
+    }
+    return 0;
+}
+
+static int compare(const char *what, const Output *expected, const Output *actual)
+{
+    size_t i = 0;
+
+    if (expected->length == actual->length && !memcmp(expected->text, actual->text, expected->length))
+        return 0;
+    while (i < expected->length && i < actual->length && expected->text[i] == actual->text[i])
+        i++;
+    printf("FAIL: %s differs at byte %zu of %zu (%zu played)\n", what, i, expected->length, actual->length);
+    return 1;
+}
+
+// Keep only the first bytes of a file, with stdio so the test runs wherever the tools do
+static int cut_file(const char *filename, long bytes)
+{
+    FILE *file = fopen(filename, "rb");
+    char *data = malloc(bytes > 0 ? bytes : 1);
+    int result = -1;
+
+    if (file && data && fread(data, 1, bytes, file) == (size_t)bytes)
+    {
+        fclose(file);
+        file = fopen(filename, "wb");
+        if (file && fwrite(data, 1, bytes, file) == (size_t)bytes)
+            result = 0;
+    }
+    if (file && fclose(file))
+        result = -1;
+    free(data);
+    return result;
+}
+
+int main(void)
+{
+    Output gcode = {0}, hpgl = {0};
+    int failures = 0;
+
+    report_missing_glyphs = 0;
+    output_dialect = DIALECT_GCODE;
+    generate(&gcode);
+
+    JobWriter *writer = job_writer_open(TEST_JOB);
+    if (!writer)
+        return 1;
+    job_writer_add(writer, gcode.text, gcode.length);
+    if (job_writer_close(writer))
+        return 1;
+    failures += check_header(&gcode);
+
+    if (job_play(TEST_JOB, play_into))
+        failures++;
+    else
+        failures += compare("G-code playback", &gcode, &played);
+
+    output_dialect = DIALECT_HPGL;
+    generate(&hpgl);
+    played.length = 0;
+    if (job_play(TEST_JOB, play_into))
+        failures++;
+    else
+        failures += compare("HP-GL playback", &hpgl, &played);
+
+    // A file that is not a job, and a job cut short
+    FILE *file = fopen(TEST_JOB, "rb");
+    long size = 0;
+    if (file)
+    {
+        fseek(file, 0, SEEK_END);
+        size = ftell(file);
+        fclose(file);
+    }
+    played.length = 0;
+    if (cut_file(TEST_JOB, size - 3) || !job_play(TEST_JOB, play_into))
+    {
+        printf("FAIL: a job cut short played without an error\n");
+        failures++;
+    }
+    file = fopen(TEST_JOB, "wb");
+    if (file)
+    {
+        fwrite(gcode.text, 1, gcode.length, file);
+        fclose(file);
+    }
+    if (!job_play(TEST_JOB, play_into))
+    {
+        printf("FAIL: a G-code file played as a job\n");
+        failures++;
+    }
+    remove(TEST_JOB);
+
+    if (failures)
+        return 1;
+    printf("%zu bytes of G-code and %zu bytes of HP-GL played back identically from the job file\n", gcode.length,
+           hpgl.length);
+    free(gcode.text);
+    free(hpgl.text);
+    free(played.text);
+    return 0;
+}
@@ -0,0 +1,157 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "font.h"
+#include "layout.h"
+#include "generator.h"
+#include "linecache.h"
+
+#define TEST_CACHE "test_linecache.cache" // Written to the working directory and removed again
+#define TEST_REPEAT 40                     // Times the text is laid out, so baselines reach far down the page
+
+// Generates a text through the line cache, then the same text with a line put in front of
+// it, so every later line lands on another baseline. The cached output must equal a fresh
+// run byte for byte in both dialects, at scales whose coordinates do not fall on the 0.01 mm
+// grid. A third run of the same document must take every line from the cache.
+
+static const char *text =
+    "The quick brown fox jumps over the lazy dog. Pack my box with five dozen liquor jugs! "
+    "Sphinx of black quartz, judge my vow. How vexingly quick daft zebras jump; the five "
+    "boxing wizards jump quickly. 0123456789 (a+b)=c/d, \"quoted\" and 'single' words.";
+
+static const float scales[] = {10, 7.5F, 13.3F};
+
+#define SCALE_COUNT (int)(sizeof(scales) / sizeof(scales[0]))
+
+static void lay_out(Document *document, float scale, int prepend)
+{
+    char word[100];
+    const char *p;
+    int length;
+
+    document_init(document, scale / CHAR_WIDTH);
+    if (prepend)
+    {
+        layout_word(document, "Prepended");
+        layout_word(document, "line");
+        document_break_line(document);
+    }
+    for (int i = 0; i < TEST_REPEAT; i++)
+    {
+        for (p = text; sscanf(p, "%99s%n", word, &length) == 1; p += length)
+            layout_word(document, word);
+    }
+}
+
+// The document's blocks joined, through the cache when it is set
+static char *generate(const Document *document, LineCache *cache, size_t *length)
+{
+    CommandBlock *blocks = malloc(document->line_count * sizeof(CommandBlock));
+    char *output = NULL;
+
+    *length = 0;
+    for (int i = 0; i < document->line_count; i++)
+        block_init(&blocks[i]);
+    if (cache)
+        line_cache_generate(cache, document, document->line_count, &embedded_font, blocks, NULL);
+    else
+        generate_lines(document, document->line_count, &embedded_font, blocks, NULL);
+    for (int i = 0; i < document->line_count; i++)
+    {
+        output = realloc(output, *length + blocks[i].length + 1);
+        memcpy(output + *length, blocks[i].text ? blocks[i].text : "", blocks[i].length);
+        *length += blocks[i].length;
+        block_free(&blocks[i]);
+    }
+    free(blocks);
+    return output;
+}
+
+static int cached_run(float scale, int prepend, const char *expected, size_t expected_length)
+{
+    Document document;
+    size_t length;
+    LineCache *cache = line_cache_open(TEST_CACHE, &embedded_font, scale / CHAR_WIDTH);
+    int failures = 0;
+
+    if (!cache)
+        return 1;
+    lay_out(&document, scale, prepend);
+    char *output = generate(&document, cache, &length);
+    if (expected && (length != expected_length || memcmp(output, expected, length)))
+    {
+        size_t i = 0;
+        while (i < length && i < expected_length && output[i] == expected[i])
+            i++;
+        printf("FAIL: %s at scale %.1f, the cached output differs from a fresh run at byte %zu: \"%.20s\"\n",
+               output_dialect == DIALECT_HPGL ? "HP-GL" : "G-code", scale, i, output + i);
+        failures++;
+    }
+    line_cache_close(cache);
+    free(output);
+    document_free(&document);
+    return failures;
+}
+
+// Every line of the document is in the cache
+static int all_cached(float scale)
+{
+    Document document;
+    LineSource source = {0};
+    CommandBlock block;
+    LineCache *cache = line_cache_open(TEST_CACHE, &embedded_font, scale / CHAR_WIDTH);
+    int hits = 0;
+
+    if (!cache)
+        return 0;
+    lay_out(&document, scale, 1);
+    block_init(&block);
+    for (int i = 0; i < document.line_count; i++)
+    {
+        line_cache_describe(cache, &document, i, &source);
+        hits += line_cache_fetch(cache, &source, &block);
+    }
+    int all = hits == document.line_count;
+    if (!all)
+        printf("FAIL: %d of %d unchanged lines taken from the cache\n", hits, document.line_count);
+    block_free(&block);
+    free(source.text);
+    line_cache_close(cache);
+    document_free(&document);
+    return all;
+}
+
+int main(void)
+{
+    int failures = 0, runs = 0;
+
+    report_missing_glyphs = 0;
+    for (int dialect = DIALECT_GCODE; dialect <= DIALECT_HPGL; dialect++)
+    {
+        output_dialect = (Dialect)dialect;
+        for (int i = 0; i < SCALE_COUNT; i++)
+        {
+            Document document;
+            size_t length;
+
+            lay_out(&document, scales[i], 1);
+            char *fresh = generate(&document, NULL, &length);
+            document_free(&document);
+
+            remove(TEST_CACHE);
+            failures += cached_run(scales[i], 0, NULL, 0);
+            failures += cached_run(scales[i], 1, fresh, length);
+            failures += cached_run(scales[i], 1, fresh, length);
+            failures += !all_cached(scales[i]);
+            free(fresh);
+            runs++;
+        }
+    }
+    remove(TEST_CACHE);
+
+    if (failures)
+        return 1;
+    printf("%d cached runs matched fresh ones after a line was put in front\n", runs);
+    return 0;
+}
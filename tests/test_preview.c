@@ -0,0 +1,261 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define TEST_COMMANDS "test_preview.gcode" // Written to the working directory and removed again
+#define TEST_SVG "test_preview.svg"
+#define TEST_PNG "test_preview.png"
+#define TEST_WIDTH 91   // 5 mm of strokes and 2 mm margins at 10 px/mm, plus the closing pixel
+#define TEST_HEIGHT 141 // 10 mm of strokes and the margins
+#define TEST_INK 102    // The 101 pixel stroke and the dot
+
+// Runs the preview tool (its path is the first argument) on a small command file: a 10 mm
+// stroke, a travel, a dot drawn as a pen-down move of no length and a last travel far off
+// the strokes. The page must be bounded by the strokes alone, the SVG must give the dot a
+// subpath of its own and the PNG must decode, with valid chunk CRCs, stored deflate blocks
+// and checksum, to exactly the expected ink.
+
+static const char commands[] = "G21\nG90\nS1000\nG4 P0.15\nG1 X0 Y-10\nS0\nG4 P0.10\nG0 X5 Y0\n"
+                               "S1000\nG4 P0.15\nG1 X5 Y0\nS0\nG4 P0.10\nG0 X50 Y20\n";
+
+static char *read_file(const char *filename, size_t *length)
+{
+    FILE *file = fopen(filename, "rb");
+    char *data = NULL;
+    long size;
+
+    if (!file)
+        return NULL;
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (size >= 0 && (data = malloc(size + 1)) && fread(data, 1, size, file) == (size_t)size)
+    {
+        data[size] = 0;
+        *length = size;
+    }
+    else
+    {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+    return data;
+}
+
+static uint32_t get_u32(const unsigned char *data)
+{
+    return (uint32_t)data[0] << 24 | (uint32_t)data[1] << 16 | (uint32_t)data[2] << 8 | data[3];
+}
+
+static uint32_t crc32(const unsigned char *data, size_t length)
+{
+    uint32_t crc = 0xFFFFFFFFU;
+
+    for (size_t i = 0; i < length; i++)
+    {
+        crc ^= data[i];
+        for (int k = 0; k < 8; k++)
+            crc = crc & 1 ? 0xEDB88320U ^ (crc >> 1) : crc >> 1;
+    }
+    return ~crc;
+}
+
+static int check_svg(void)
+{
+    size_t length;
+    char *svg = read_file(TEST_SVG, &length);
+    int failures = 0;
+
+    if (!svg)
+    {
+        printf("FAIL: no SVG written\n");
+        return 1;
+    }
+    if (!strstr(svg, "viewBox=\"0 0 9.00 14.00\""))
+    {
+        printf("FAIL: the SVG page is not bounded by the strokes\n");
+        failures++;
+    }
+    if (!strstr(svg, "M2.00 2.00L2.00 12.00M7.00 2.00L7.00 2.00\""))
+    {
+        printf("FAIL: the SVG has no stroke and dot subpaths\n");
+        failures++;
+    }
+    if (strstr(svg, "stroke=\"red\""))
+    {
+        printf("FAIL: travel drawn without --travel\n");
+        failures++;
+    }
+    free(svg);
+    return failures;
+}
+
+// The IDAT stream of the file, every chunk checked on the way
+static unsigned char *read_png(size_t *length, uint32_t *width, uint32_t *height)
+{
+    static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    size_t size, offset = 8;
+    unsigned char *png = (unsigned char *)read_file(TEST_PNG, &size), *idat = NULL;
+    int ended = 0;
+
+    *length = 0;
+    if (!png || size < 8 || memcmp(png, signature, 8))
+    {
+        printf("FAIL: no PNG signature\n");
+        free(png);
+        return NULL;
+    }
+    while (!ended && offset + 12 <= size)
+    {
+        uint32_t chunk = get_u32(png + offset);
+        const unsigned char *type = png + offset + 4, *data = type + 4;
+
+        if (chunk > size - offset - 12 || get_u32(data + chunk) != crc32(type, chunk + 4))
+        {
+            printf("FAIL: PNG chunk %.4s has a bad length or CRC\n", type);
+            break;
+        }
+        if (!memcmp(type, "IHDR", 4))
+        {
+            *width = get_u32(data);
+            *height = get_u32(data + 4);
+            if (chunk != 13 || data[8] != 2 || data[9] != 3)
+                printf("FAIL: IHDR is not 2 bit indexed colour\n");
+        }
+        else if (!memcmp(type, "IDAT", 4))
+        {
+            idat = realloc(idat, *length + chunk);
+            memcpy(idat + *length, data, chunk);
+            *length += chunk;
+        }
+        else if (!memcmp(type, "IEND", 4))
+            ended = 1;
+        offset += chunk + 12;
+    }
+    free(png);
+    if (!ended || !idat)
+    {
+        printf("FAIL: PNG cut short\n");
+        free(idat);
+        return NULL;
+    }
+    return idat;
+}
+
+static int check_png(void)
+{
+    size_t length, raw = 0;
+    uint32_t width = 0, height = 0;
+    unsigned char *idat = read_png(&length, &width, &height);
+
+    if (!idat)
+        return 1;
+    if (width != TEST_WIDTH || height != TEST_HEIGHT)
+    {
+        printf("FAIL: PNG is %ux%u, expected %dx%d\n", width, height, TEST_WIDTH, TEST_HEIGHT);
+        free(idat);
+        return 1;
+    }
+
+    // zlib header, stored blocks until the final one, then the Adler-32 of the rows
+    size_t row_bytes = 1 + (width + 3) / 4, offset = 2;
+    unsigned char *pixels = malloc(row_bytes * height);
+    int last = 0, failures = 0;
+
+    if (length < 2 || idat[0] != 0x78 || (idat[0] * 256 + idat[1]) % 31)
+        failures++;
+    while (!failures && !last && offset + 5 <= length)
+    {
+        size_t block = idat[offset + 1] | idat[offset + 2] << 8;
+
+        last = idat[offset] & 1;
+        if ((idat[offset] & 6) || (block ^ (idat[offset + 3] | idat[offset + 4] << 8)) != 0xFFFF ||
+            offset + 5 + block > length || raw + block > row_bytes * height)
+            failures++;
+        else
+        {
+            memcpy(pixels + raw, idat + offset + 5, block);
+            raw += block;
+            offset += 5 + block;
+        }
+    }
+    uint32_t a = 1, b = 0;
+    for (size_t i = 0; i < raw; i++)
+    {
+        a = (a + pixels[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    if (failures || !last || raw != row_bytes * height || offset + 4 != length || get_u32(idat + offset) != (b << 16 | a))
+    {
+        printf("FAIL: the PNG image data is not a valid stored zlib stream\n");
+        free(pixels);
+        free(idat);
+        return 1;
+    }
+
+    int ink = 0, dot = 0;
+    for (uint32_t y = 0; y < height; y++)
+    {
+        const unsigned char *row = pixels + y * row_bytes;
+        if (row[0])
+            failures++; // Filter type None on every row
+        for (uint32_t x = 0; x < width; x++)
+        {
+            int pixel = row[1 + x / 4] >> (6 - 2 * (x % 4)) & 3;
+            ink += pixel == 1;
+            if (pixel == 1 && x == 70 && y == 20)
+                dot = 1;
+            if (pixel > 1)
+                failures++; // Travel colour without --travel
+        }
+    }
+    if (failures || !dot || ink != TEST_INK)
+    {
+        printf("FAIL: PNG has %d ink pixels, expected %d, the dot %s\n", ink, TEST_INK, dot ? "drawn" : "missing");
+        failures++;
+    }
+    free(pixels);
+    free(idat);
+    return failures;
+}
+
+int main(int argc, char *argv[])
+{
+    char command[1024];
+    FILE *file;
+    int failures = 0;
+
+    if (argc < 2)
+    {
+        printf("Usage: %s <preview tool>\n", argv[0]);
+        return 1;
+    }
+    file = fopen(TEST_COMMANDS, "w");
+    if (!file || fputs(commands, file) == EOF || fclose(file))
+    {
+        printf("FAIL: unable to write %s\n", TEST_COMMANDS);
+        return 1;
+    }
+
+    snprintf(command, sizeof(command), "\"%s\" %s --svg %s --png %s", argv[1], TEST_COMMANDS, TEST_SVG, TEST_PNG);
+    if (system(command))
+    {
+        printf("FAIL: %s\n", command);
+        failures++;
+    }
+    else
+    {
+        failures += check_svg();
+        failures += check_png();
+    }
+    remove(TEST_COMMANDS);
+    remove(TEST_SVG);
+    remove(TEST_PNG);
+
+    if (failures)
+        return 1;
+    printf("Stroke and dot rendered to a %dx%d PNG and SVG bounded by the strokes\n", TEST_WIDTH, TEST_HEIGHT);
+    return 0;
+}
@@ -0,0 +1,167 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "reply.h"
+
+#define TEST_ROUNDS 2000 // Times the reply set is streamed through the ring
+
+// Streams a fixed set of controller replies through the ring in reads of every size from
+// 1 to 97 bytes, so lines keep straddling the end of the ring, and checks each line's
+// kind, code and text. A second pass starts the byte counters just short of overflow,
+// and a line longer than the ring must be dropped without losing the one after it.
+
+typedef struct
+{
+    const char *wire; // As received, line end included
+    ReplyKind kind;
+    int code;
+    const char *text; // As handed out
+} Expected;
+
+static const Expected replies[] = {
+    {"ok\r\n", REPLY_OK, -1, "ok"},
+    {"error:20\r\n", REPLY_ERROR, 20, "error:20"},
+    {"<Run|MPos:12.500,-3.250,0.000|Bf:14,97|FS:1000,0>\r\n", REPLY_STATUS, -1,
+     "<Run|MPos:12.500,-3.250,0.000|Bf:14,97|FS:1000,0>"},
+    {"Resend: 4711\r\n", REPLY_RESEND, 4711, "Resend: 4711"},
+    {"rs 12\n", REPLY_RESEND, 12, "rs 12"},
+    {"ALARM:3\r\n", REPLY_ALARM, 3, "ALARM:3"},
+    {"Grbl 1.1h ['$' for help]\r\n", REPLY_BANNER, -1, "Grbl 1.1h ['$' for help]"},
+    {"[MSG:Caution: Unlocked]\r\n", REPLY_OTHER, -1, "[MSG:Caution: Unlocked]"},
+    {"\r\n", REPLY_OTHER, -1, ""},
+};
+
+#define REPLY_COUNT (int)(sizeof(replies) / sizeof(replies[0]))
+
+static int failures;
+
+static void check_line(const ReplyLine *line, int index)
+{
+    const Expected *expected = &replies[index % REPLY_COUNT];
+    int length = (int)strlen(expected->text);
+
+    if (line->kind != expected->kind || line->code != expected->code || line->length != length ||
+        memcmp(line->text, expected->text, length))
+    {
+        printf("FAIL: line %d is \"%.*s\" kind %d code %d, expected \"%s\" kind %d code %d\n", index, line->length,
+               line->text, line->kind, line->code, expected->text, expected->kind, expected->code);
+        failures++;
+    }
+}
+
+// Feed TEST_ROUNDS copies of the replies and check every line that comes out
+static void stream_replies(ReplyParser *parser)
+{
+    size_t total = 0, offset = 0;
+    int chunk = 1, received = 0;
+    ReplyLine line;
+
+    for (int i = 0; i < REPLY_COUNT; i++)
+        total += strlen(replies[i].wire);
+    char *stream = malloc(total * TEST_ROUNDS);
+    if (!stream)
+        exit(1);
+    for (int round = 0; round < TEST_ROUNDS; round++)
+    {
+        for (int i = 0; i < REPLY_COUNT; i++)
+        {
+            size_t length = strlen(replies[i].wire);
+            memcpy(stream + offset, replies[i].wire, length);
+            offset += length;
+        }
+    }
+
+    for (offset = 0; offset < total * TEST_ROUNDS && !failures;)
+    {
+        int size;
+        unsigned char *space = ReplySpace(parser, &size);
+        int n = chunk < size ? chunk : size;
+
+        if (offset + n > total * TEST_ROUNDS)
+            n = (int)(total * TEST_ROUNDS - offset);
+        memcpy(space, stream + offset, n);
+        ReplyCommit(parser, n);
+        offset += n;
+        chunk = chunk % 97 + 1;
+
+        while (ReplyNext(parser, &line) && !failures)
+            check_line(&line, received++);
+    }
+
+    if (!failures && received != REPLY_COUNT * TEST_ROUNDS)
+    {
+        printf("FAIL: %d lines out of %d\n", received, REPLY_COUNT * TEST_ROUNDS);
+        failures++;
+    }
+    if (parser->dropped)
+    {
+        printf("FAIL: %lu bytes dropped from lines that fit\n", parser->dropped);
+        failures++;
+    }
+    free(stream);
+}
+
+static void test_overlong_line(void)
+{
+    static ReplyParser parser;
+    ReplyLine line;
+    int size, sent = 0;
+
+    ReplyInit(&parser);
+    while (sent < REPLY_RING_SIZE + 100)
+    {
+        unsigned char *space = ReplySpace(&parser, &size);
+        int n = size < 64 ? size : 64;
+
+        memset(space, 'x', n);
+        ReplyCommit(&parser, n);
+        sent += n;
+        if (ReplyNext(&parser, &line))
+        {
+            printf("FAIL: an unfinished line was handed out\n");
+            failures++;
+            return;
+        }
+    }
+
+    // The tail of the long line ends at this newline, then a real reply follows
+    const char *rest = "\nok\r\n";
+    unsigned char *space = ReplySpace(&parser, &size);
+    memcpy(space, rest, strlen(rest));
+    ReplyCommit(&parser, (int)strlen(rest));
+
+    if (!parser.dropped)
+    {
+        printf("FAIL: a line longer than the ring was kept\n");
+        failures++;
+    }
+    while (ReplyNext(&parser, &line) && line.kind != REPLY_OK)
+        ;
+    if (line.kind != REPLY_OK || line.length != 2)
+    {
+        printf("FAIL: the reply after an over-long line was lost\n");
+        failures++;
+    }
+}
+
+int main(void)
+{
+    static ReplyParser parser;
+
+    ReplyInit(&parser);
+    stream_replies(&parser);
+
+    // Byte counters about to overflow, positions in the ring must still line up
+    ReplyInit(&parser);
+    parser.head = parser.tail = parser.scanned = 0xFFFFFFFFU - 1000;
+    stream_replies(&parser);
+
+    test_overlong_line();
+
+    if (failures)
+        return 1;
+    printf("%d replies framed across the ring end, counter overflow and an over-long line handled\n",
+           2 * REPLY_COUNT * TEST_ROUNDS);
+    return 0;
+}
@@ -0,0 +1,191 @@
+#define _GNU_SOURCE /* posix_openpt and ptsname */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "rs232.h"
+
+#define TEST_COMMANDS 2000 // Round trips per handle
+#define TEST_PORTS 2       // Handles driven at the same time, one thread each
+
+// Two rs232.c handles on two pseudo terminals, each driven from its own thread. Every
+// command must arrive intact on its own pty and every reply on its own handle, with the
+// per-handle counters matching. Then a comport number is opened twice to check that the
+// legacy interface closes the handle it replaces.
+
+typedef struct
+{
+    int master;
+    char device[RS232_NAME_SIZE];
+    int failures;
+} PortTest;
+
+static int open_pty(PortTest *test)
+{
+    struct termios settings;
+    int slave;
+
+    test->master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (test->master == -1 || grantpt(test->master) || unlockpt(test->master))
+        return -1;
+    snprintf(test->device, sizeof(test->device), "%s", ptsname(test->master));
+
+    // Raw on both ends, so the pty passes every byte through unchanged
+    slave = open(test->device, O_RDWR | O_NOCTTY);
+    if (slave == -1 || tcgetattr(slave, &settings))
+        return -1;
+    cfmakeraw(&settings);
+    tcsetattr(slave, TCSANOW, &settings);
+    close(slave);
+    return 0;
+}
+
+// Read exactly length bytes, the low latency handle returns after the first one
+static int read_reply(RS232_Port *port, unsigned char *buf, int length)
+{
+    int n = 0, tries = 0;
+
+    while (n < length && tries++ < 1000)
+    {
+        int r = RS232_Read(port, buf + n, length - n);
+        if (r < 0)
+            return -1;
+        n += r;
+    }
+    return n;
+}
+
+static void *run_port(void *arg)
+{
+    PortTest *test = arg;
+    RS232_Port *port = RS232_Open(test->device, 115200, "8N1", RS232_LOW_LATENCY);
+    unsigned char command[32], received[32], reply[8];
+    RS232_Stats stats;
+
+    if (!port)
+    {
+        printf("FAIL: unable to open %s\n", test->device);
+        test->failures++;
+        return NULL;
+    }
+
+    for (int i = 0; i < TEST_COMMANDS && !test->failures; i++)
+    {
+        int length = snprintf((char *)command, sizeof(command), "G1 X%d Y%d\n", i, test->master);
+        int n = 0;
+
+        if (RS232_Write(port, command, length) != length)
+        {
+            printf("FAIL: short write on %s\n", test->device);
+            test->failures++;
+            break;
+        }
+        while (n < length)
+        {
+            int r = (int)read(test->master, received + n, length - n);
+            if (r <= 0)
+                break;
+            n += r;
+        }
+        if (n != length || memcmp(received, command, length))
+        {
+            printf("FAIL: %s received %.*s for %.*s", test->device, n, received, length, command);
+            test->failures++;
+            break;
+        }
+
+        int id = i & 0xFF;
+        reply[0] = 'o';
+        reply[1] = 'k';
+        reply[2] = (unsigned char)id;
+        reply[3] = '\n';
+        if (write(test->master, reply, 4) != 4 || read_reply(port, reply, 4) != 4 || reply[2] != id)
+        {
+            printf("FAIL: %s lost reply %d\n", test->device, i);
+            test->failures++;
+        }
+    }
+
+    RS232_GetStats(port, &stats);
+    if (!test->failures && (stats.bytes_received != 4ULL * TEST_COMMANDS || stats.write_errors || stats.read_errors))
+    {
+        printf("FAIL: %s counted %llu bytes received, %lu write and %lu read errors\n", test->device,
+               stats.bytes_received, stats.write_errors, stats.read_errors);
+        test->failures++;
+    }
+    if (strcmp(RS232_PortDevice(port), test->device))
+    {
+        printf("FAIL: handle reports %s for %s\n", RS232_PortDevice(port), test->device);
+        test->failures++;
+    }
+    RS232_Close(port);
+    return NULL;
+}
+
+// Lowest free descriptor, a leaked handle keeps it from coming back
+static int lowest_free_fd(void)
+{
+    int fd = dup(0);
+    close(fd);
+    return fd;
+}
+
+static int test_legacy_reopen(const PortTest *test)
+{
+    int before = lowest_free_fd();
+
+    if (RS232_SetPortName(0, test->device) || RS232_OpenComport(0, 115200, "8N1") ||
+        RS232_OpenComport(0, 115200, "8N1"))
+    {
+        printf("FAIL: unable to open %s as comport 0\n", test->device);
+        return 1;
+    }
+    RS232_CloseComport(0);
+
+    if (lowest_free_fd() != before)
+    {
+        printf("FAIL: reopening comport 0 leaked the first handle\n");
+        return 1;
+    }
+    return 0;
+}
+
+int main(void)
+{
+    PortTest tests[TEST_PORTS];
+    pthread_t threads[TEST_PORTS];
+    int failures = 0;
+
+    memset(tests, 0, sizeof(tests));
+    for (int i = 0; i < TEST_PORTS; i++)
+    {
+        if (open_pty(&tests[i]))
+        {
+            perror("unable to create pseudo terminal");
+            return 1;
+        }
+    }
+
+    for (int i = 0; i < TEST_PORTS; i++)
+        pthread_create(&threads[i], NULL, run_port, &tests[i]);
+    for (int i = 0; i < TEST_PORTS; i++)
+    {
+        pthread_join(threads[i], NULL);
+        failures += tests[i].failures;
+    }
+
+    failures += test_legacy_reopen(&tests[0]);
+
+    for (int i = 0; i < TEST_PORTS; i++)
+        close(tests[i].master);
+
+    if (failures)
+        return 1;
+    printf("%d handles, %d round trips each, legacy reopen closes the old handle\n", TEST_PORTS, TEST_COMMANDS);
+    return 0;
+}
@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "textpipe.h"
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#define read _read
+#define close _close
+#define STDIN_FILENO 0
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+int text_pipe_open(TextPipe *input, const char *source)
+{
+    memset(input, 0, sizeof(*input));
+
+    if (!strcmp(source, "-"))
+    {
+        input->fd = STDIN_FILENO;
+        return 0;
+    }
+
+    // Opening a FIFO waits here until a writer connects
+    input->fd = open(source, O_RDONLY);
+    if (input->fd == -1)
+    {
+        printf("Error opening file: %s\n", source);
+        return -1;
+    }
+    return 0;
+}
+
+void text_pipe_close(TextPipe *input)
+{
+    if (input->fd != STDIN_FILENO)
+        close(input->fd);
+}
+
+// Wait for more text, 0 if none arrived within idle_ms. Windows reads simply block.
+static int wait_readable(TextPipe *input, int idle_ms)
+{
+#ifdef _WIN32
+    (void)input;
+    (void)idle_ms;
+    return 1;
+#else
+    struct pollfd request = {input->fd, POLLIN, 0};
+    int ready;
+
+    do
+        ready = poll(&request, 1, idle_ms);
+    while (ready < 0 && errno == EINTR);
+    return ready != 0;
+#endif
+}
+
+// Hand out the word collected so far, the event that ended it comes next
+static PipeEvent finish_word(TextPipe *input, PipeEvent next)
+{
+    input->word[input->word_length] = 0;
+    input->word_taken = 1;
+    if (next != PIPE_WORD)
+    {
+        input->pending = next;
+        input->has_pending = 1;
+    }
+    return PIPE_WORD;
+}
+
+PipeEvent text_pipe_next(TextPipe *input, int idle_ms)
+{
+    if (input->word_taken)
+    {
+        input->word_length = 0;
+        input->word_taken = 0;
+    }
+    if (input->has_pending)
+    {
+        input->has_pending = 0;
+        return input->pending;
+    }
+
+    while (1)
+    {
+        while (input->start < input->length)
+        {
+            unsigned char c = (unsigned char)input->buffer[input->start++];
+
+            if (c == '\n')
+                return input->word_length ? finish_word(input, PIPE_LINE_END) : PIPE_LINE_END;
+            if (isspace(c))
+            {
+                if (input->word_length)
+                    return finish_word(input, PIPE_WORD);
+                continue;
+            }
+            input->word[input->word_length++] = (char)c;
+            if (input->word_length == PIPE_WORD_SIZE - 1)
+                return finish_word(input, PIPE_WORD);
+        }
+
+        if (input->closed)
+            return input->word_length ? finish_word(input, PIPE_END) : PIPE_END;
+
+        // A word cut off by a pause is taken as it is, the writer may never finish it
+        if (!wait_readable(input, idle_ms))
+            return input->word_length ? finish_word(input, PIPE_IDLE) : PIPE_IDLE;
+
+        int n = (int)read(input->fd, input->buffer, sizeof(input->buffer));
+        if (n <= 0)
+        {
+#ifndef _WIN32
+            if (n < 0 && errno == EINTR)
+                continue;
+#endif
+            input->closed = 1; // Closed by the writer, or unreadable
+            n = 0;
+        }
+        input->start = 0;
+        input->length = n;
+    }
+}
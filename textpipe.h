@@ -0,0 +1,35 @@
+#ifndef TEXTPIPE_H_INCLUDED
+#define TEXTPIPE_H_INCLUDED
+
+#define PIPE_IDLE_MS 1000  // Quiet time after which a partly filled line is drawn anyway
+#define PIPE_BUFFER 4096   // Bytes read from the pipe at a time
+#define PIPE_WORD_SIZE 100 // Longer words are split, as fscanf("%99s") does for files
+
+typedef enum
+{
+    PIPE_WORD,     // A complete word is in TextPipe.word
+    PIPE_LINE_END, // The writer ended a line
+    PIPE_IDLE,     // Nothing arrived for the idle time
+    PIPE_END       // The writer closed the pipe
+} PipeEvent;
+
+// Text arriving on stdin or a FIFO, split into words as it comes. Memory stays the
+// same however much text goes through.
+typedef struct
+{
+    int fd;
+    char buffer[PIPE_BUFFER];
+    int start, length; // Unread part of buffer
+    char word[PIPE_WORD_SIZE];
+    int word_length;
+    int word_taken;    // word was handed out, the next call starts a new one
+    PipeEvent pending; // Event that ended the word, reported by the next call
+    int has_pending;
+    int closed;
+} TextPipe;
+
+int text_pipe_open(TextPipe *input, const char *source); // "-" for stdin, or a FIFO or file, 0 on success
+PipeEvent text_pipe_next(TextPipe *input, int idle_ms);  // Wait up to idle_ms for the next event
+void text_pipe_close(TextPipe *input);
+
+#endif // TEXTPIPE_H_INCLUDED
@@ -0,0 +1,39 @@
+#include "timer.h"
+
+#if defined(__linux__) || defined(__FreeBSD__)
+
+#include <time.h>
+
+// Read the monotonic clock, which never jumps with wall-clock changes
+long long TimerMicros(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+}
+
+#else
+
+#include <windows.h>
+
+// Read the performance counter, Windows' monotonic high resolution clock
+long long TimerMicros(void)
+{
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER now;
+
+    if (frequency.QuadPart == 0)
+        QueryPerformanceFrequency(&frequency);
+
+    QueryPerformanceCounter(&now);
+    return (long long)(now.QuadPart / frequency.QuadPart) * 1000000LL +
+           (long long)(now.QuadPart % frequency.QuadPart) * 1000000LL / frequency.QuadPart;
+}
+
+#endif
+
+long long TimerMillis(void)
+{
+    return TimerMicros() / 1000;
+}
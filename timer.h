@@ -0,0 +1,7 @@
+#ifndef TIMER_H_INCLUDED
+#define TIMER_H_INCLUDED
+
+long long TimerMicros(void); // Monotonic time in microseconds (arbitrary epoch)
+long long TimerMillis(void); // Monotonic time in milliseconds (arbitrary epoch)
+
+#endif // TIMER_H_INCLUDED
@@ -0,0 +1,155 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include "trace.h"
+#include "timer.h"
+
+// Spans are appended to a preallocated array with one atomic increment and written out only
+// at exit, so tracing adds no I/O to the job it is measuring. The output is the Chrome
+// trace-event format, which chrome://tracing and ui.perfetto.dev both open.
+
+typedef struct
+{
+    const char *category; // Static strings, only the pointers are stored
+    const char *name;
+    long long start;      // TimerMicros()
+    int duration;         // us
+    int thread;
+    char detail[TRACE_DETAIL_SIZE];
+} TraceEvent;
+
+// Workers and the status poller test this on every span while TraceFlush clears it at exit
+atomic_int trace_enabled;
+static int trace_detail; // Set before any worker starts, read only after
+
+static TraceEvent *events;
+static atomic_int event_count;
+static atomic_int next_thread = 1;
+static _Thread_local int thread_id;
+static char *trace_filename;
+static long long trace_origin;
+
+int TraceStart(const char *filename)
+{
+    events = malloc(TRACE_MAX_EVENTS * sizeof(TraceEvent));
+    trace_filename = malloc(strlen(filename) + 1);
+    if (!events || !trace_filename)
+    {
+        printf("Unable to allocate the trace buffer\n");
+        return (-1);
+    }
+    strcpy(trace_filename, filename);
+
+    trace_origin = TimerMicros();
+    atomic_store(&trace_enabled, 1);
+    return (0);
+}
+
+void TraceDetail(int enabled)
+{
+    trace_detail = enabled;
+}
+
+long long TraceBegin(void)
+{
+    return atomic_load_explicit(&trace_enabled, memory_order_relaxed) ? TimerMicros() : 0;
+}
+
+long long TraceBeginDetail(void)
+{
+    return trace_detail ? TraceBegin() : 0;
+}
+
+void TraceEnd(const char *category, const char *name, long long start, const char *detail, int detail_length)
+{
+    if (!start || !atomic_load_explicit(&trace_enabled, memory_order_relaxed))
+        return;
+
+    long long end = TimerMicros();
+    int index = atomic_fetch_add_explicit(&event_count, 1, memory_order_relaxed);
+    if (index >= TRACE_MAX_EVENTS)
+        return; // Counted by event_count, reported at flush
+
+    if (!thread_id)
+        thread_id = atomic_fetch_add(&next_thread, 1);
+
+    TraceEvent *event = &events[index];
+    event->category = category;
+    event->name = name;
+    event->start = start;
+    event->duration = (int)(end - start);
+    event->thread = thread_id;
+
+    if (detail_length < 0)
+        detail_length = detail ? (int)strlen(detail) : 0;
+    if (detail_length >= TRACE_DETAIL_SIZE)
+        detail_length = TRACE_DETAIL_SIZE - 1;
+    if (detail_length)
+        memcpy(event->detail, detail, detail_length);
+    event->detail[detail_length] = 0;
+}
+
+// Function to write a string as a JSON literal, dropping the trailing newline of commands
+static void WriteJsonString(FILE *file, const char *text)
+{
+    fputc('"', file);
+    for (; *text; text++)
+    {
+        unsigned char c = (unsigned char)*text;
+        if (c == '"' || c == '\\')
+            fprintf(file, "\\%c", c);
+        else if (c == '\n' && !text[1])
+            break;
+        else if (c < 32)
+            fprintf(file, "\\u%04x", c);
+        else
+            fputc(c, file);
+    }
+    fputc('"', file);
+}
+
+void TraceFlush(void)
+{
+    FILE *file;
+    int count;
+
+    if (!atomic_exchange(&trace_enabled, 0))
+        return;
+
+    count = atomic_load(&event_count);
+    if (count > TRACE_MAX_EVENTS)
+    {
+        printf("Trace buffer full, %d events dropped\n", count - TRACE_MAX_EVENTS);
+        count = TRACE_MAX_EVENTS;
+    }
+
+    file = fopen(trace_filename, "w");
+    if (!file)
+    {
+        printf("Unable to create trace file: %s\n", trace_filename);
+        return;
+    }
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for (int i = 0; i < count; i++)
+    {
+        const TraceEvent *event = &events[i];
+        fprintf(file, "%s{\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%lld,\"dur\":%d,\"cat\":\"%s\",\"name\":",
+                i ? ",\n" : "", event->thread, event->start - trace_origin, event->duration, event->category);
+        WriteJsonString(file, event->name);
+        if (event->detail[0])
+        {
+            fprintf(file, ",\"args\":{\"detail\":");
+            WriteJsonString(file, event->detail);
+            fputc('}', file);
+        }
+        fputc('}', file);
+    }
+    fprintf(file, "\n]}\n");
+    fclose(file);
+
+    printf("Trace with %d events written to %s\n", count, trace_filename);
+    // The buffer stays allocated: on an error exit a worker may still be finishing a span
+}
@@ -0,0 +1,18 @@
+#ifndef TRACE_H_INCLUDED
+#define TRACE_H_INCLUDED
+
+#include <stdatomic.h>
+
+#define TRACE_MAX_EVENTS (1 << 20) /* Events kept in memory, later ones are counted and dropped */
+#define TRACE_DETAIL_SIZE 28       /* Bytes of detail text kept per event */
+
+extern atomic_int trace_enabled; // Set once tracing has started, spans cost nothing when it is off
+
+int TraceStart(const char *filename); // Buffer events in memory, written as JSON by TraceFlush
+void TraceDetail(int enabled);        // Also record the fine-grained spans, one per generated word
+long long TraceBegin(void);           // Start time of a span, 0 when tracing is off
+long long TraceBeginDetail(void);     // Same for a fine-grained span, 0 unless TraceDetail(1) was called
+void TraceEnd(const char *category, const char *name, long long start, const char *detail, int detail_length);
+void TraceFlush(void); // Write the Chrome trace-event file, called at exit
+
+#endif // TRACE_H_INCLUDED
@@ -0,0 +1,296 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "transport.h"
+#include "serial.h"
+#include "rs232.h"
+#include "log.h"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef SOCKET Socket;
+#define NO_SOCKET INVALID_SOCKET
+#define CloseSocket closesocket
+#define WouldBlock() (WSAGetLastError() == WSAEWOULDBLOCK)
+#define SEND_FLAGS 0
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+typedef int Socket;
+#define NO_SOCKET -1
+#define CloseSocket close
+#define WouldBlock() (errno == EAGAIN || errno == EWOULDBLOCK)
+#ifdef MSG_NOSIGNAL
+#define SEND_FLAGS MSG_NOSIGNAL /* A closed bridge is reported, not raised as SIGPIPE */
+#else
+#define SEND_FLAGS 0
+#endif
+#endif
+
+// Serial port through rs232.c, on a handle of its own
+
+static RS232_Port *serial_port;
+
+static int SerialOpen(const char *target)
+{
+    char mode[] = {'8', 'N', '1', 0};
+    const char *device = target ? target : RS232_GetPortName(cport_nr);
+
+#ifdef SERIAL_LOW_LATENCY
+    int options = RS232_LOW_LATENCY;
+#else
+    int options = 0;
+#endif
+    if (HardwareFlow())
+        options |= RS232_HW_FLOW;
+
+    if (serial_port)
+        RS232_Close(serial_port);
+    serial_port = RS232_Open(device, bdrate, mode, options);
+    if (!serial_port)
+    {
+        LogPrintf(LOG_ERROR, "Can not open comport %s", device);
+        return (-1);
+    }
+    return (0);
+}
+
+static int SerialRead(unsigned char *buf, int size)
+{
+    int n = RS232_Read(serial_port, buf, size);
+    return n < 0 ? 0 : n; // A serial line never closes, errors are transient
+}
+
+static int SerialWrite(const unsigned char *data, int length)
+{
+    return RS232_Write(serial_port, data, length);
+}
+
+static void SerialClose(void)
+{
+    if (serial_port)
+        RS232_Close(serial_port);
+    serial_port = NULL;
+}
+
+RS232_Port *SerialPort(void)
+{
+    return serial_port;
+}
+
+// In low latency mode a serial read already waits for the first byte of a reply
+#ifdef SERIAL_LOW_LATENCY
+const Transport serial_transport = {"serial", SerialOpen, SerialRead, SerialWrite, SerialClose, 0, 1};
+#else
+const Transport serial_transport = {"serial", SerialOpen, SerialRead, SerialWrite, SerialClose, 0, 0};
+#endif
+
+// TCP bridge, host:port
+
+static Socket tcp_socket = NO_SOCKET;
+
+static int TcpOpen(const char *target)
+{
+    char host[256], port[16];
+    struct addrinfo hints, *addresses, *address;
+    const char *colon;
+    int nodelay = 1;
+
+    if (!target)
+    {
+        LogPrintf(LOG_ERROR, "The tcp transport needs --device <host:port>");
+        return (-1);
+    }
+
+    colon = strrchr(target, ':');
+    if (colon && (size_t)(colon - target) < sizeof(host))
+    {
+        memcpy(host, target, colon - target);
+        host[colon - target] = 0;
+        snprintf(port, sizeof(port), "%s", colon + 1);
+    }
+    else
+    {
+        snprintf(host, sizeof(host), "%s", target);
+        snprintf(port, sizeof(port), "%d", TCP_DEFAULT_PORT);
+    }
+
+#ifdef _WIN32
+    WSADATA wsa;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa))
+        return (-1);
+#endif
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, port, &hints, &addresses))
+    {
+        LogPrintf(LOG_ERROR, "Unknown host %s", host);
+        return (-1);
+    }
+
+    for (address = addresses; address; address = address->ai_next)
+    {
+        tcp_socket = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if (tcp_socket == NO_SOCKET)
+            continue;
+        if (!connect(tcp_socket, address->ai_addr, (int)address->ai_addrlen))
+            break;
+        CloseSocket(tcp_socket);
+        tcp_socket = NO_SOCKET;
+    }
+    freeaddrinfo(addresses);
+
+    if (tcp_socket == NO_SOCKET)
+    {
+        LogPrintf(LOG_ERROR, "Unable to connect to %s:%s", host, port);
+        return (-1);
+    }
+
+    // Commands are short and each one waits on the controller, send them right away
+    setsockopt(tcp_socket, IPPROTO_TCP, TCP_NODELAY, (const char *)&nodelay, sizeof(nodelay));
+#ifdef _WIN32
+    u_long nonblocking = 1;
+    ioctlsocket(tcp_socket, FIONBIO, &nonblocking);
+#else
+    fcntl(tcp_socket, F_SETFL, fcntl(tcp_socket, F_GETFL) | O_NONBLOCK);
+#endif
+
+    LogPrintf(LOG_INFO, "Connected to %s:%s", host, port);
+    return (0);
+}
+
+// Wait up to TCP_READ_WAIT for data, a reply wakes the reader as soon as it arrives
+static int TcpRead(unsigned char *buf, int size)
+{
+    struct timeval wait = {0, TCP_READ_WAIT * 1000};
+    fd_set readable;
+
+    FD_ZERO(&readable);
+    FD_SET(tcp_socket, &readable);
+    if (select((int)tcp_socket + 1, &readable, NULL, NULL, &wait) <= 0)
+        return 0; // Nothing yet, or interrupted
+
+    int n = (int)recv(tcp_socket, (char *)buf, size, 0);
+
+    if (n > 0)
+        return n;
+    if (n < 0 && WouldBlock())
+        return 0;
+    return (-1); // Closed by the bridge
+}
+
+static int TcpWrite(const unsigned char *data, int length)
+{
+    int n = (int)send(tcp_socket, (const char *)data, length, SEND_FLAGS);
+
+    if (n < 0)
+        return WouldBlock() ? 0 : -1;
+    return n;
+}
+
+static void TcpClose(void)
+{
+    if (tcp_socket == NO_SOCKET)
+        return;
+    CloseSocket(tcp_socket);
+    tcp_socket = NO_SOCKET;
+#ifdef _WIN32
+    WSACleanup();
+#endif
+}
+
+const Transport tcp_transport = {"tcp", TcpOpen, TcpRead, TcpWrite, TcpClose, 0, 1};
+
+// File, console and null sinks. Nothing answers, serial.c acknowledges for them.
+
+static FILE *sink_file;
+
+static int NoRead(unsigned char *buf, int size)
+{
+    (void)buf;
+    (void)size;
+    return 0;
+}
+
+static int FileOpen(const char *target)
+{
+    if (!target)
+    {
+        LogPrintf(LOG_ERROR, "The file transport needs --device <file>");
+        return (-1);
+    }
+    sink_file = fopen(target, "wb");
+    if (!sink_file)
+    {
+        LogPrintf(LOG_ERROR, "Unable to create %s", target);
+        return (-1);
+    }
+    return (0);
+}
+
+static int FileWrite(const unsigned char *data, int length)
+{
+    return fwrite(data, 1, length, sink_file) == (size_t)length ? length : -1;
+}
+
+static void FileClose(void)
+{
+    if (sink_file)
+        fclose(sink_file);
+    sink_file = NULL;
+}
+
+const Transport file_transport = {"file", FileOpen, NoRead, FileWrite, FileClose, 1, 0};
+
+static int ConsoleOpen(const char *target)
+{
+    (void)target;
+    return (0);
+}
+
+static int ConsoleWrite(const unsigned char *data, int length)
+{
+    return (int)fwrite(data, 1, length, stdout);
+}
+
+static void ConsoleClose(void)
+{
+    fflush(stdout);
+}
+
+const Transport console_transport = {"console", ConsoleOpen, NoRead, ConsoleWrite, ConsoleClose, 1, 0};
+
+static int NullWrite(const unsigned char *data, int length)
+{
+    (void)data;
+    return length;
+}
+
+static void NullClose(void)
+{
+}
+
+const Transport null_transport = {"null", ConsoleOpen, NoRead, NullWrite, NullClose, 1, 0};
+
+const Transport *FindTransport(const char *name)
+{
+    static const Transport *transports[] = {&serial_transport, &tcp_transport, &file_transport, &null_transport,
+                                            &console_transport};
+
+    for (size_t i = 0; i < sizeof(transports) / sizeof(transports[0]); i++)
+    {
+        if (!strcmp(transports[i]->name, name))
+            return transports[i];
+    }
+    return NULL;
+}
@@ -0,0 +1,31 @@
+#ifndef TRANSPORT_H_INCLUDED
+#define TRANSPORT_H_INCLUDED
+
+#define TCP_DEFAULT_PORT 23 /* Port of a GRBL TCP bridge when the target gives none */
+#define TCP_READ_WAIT 10    /* Longest wait for data in a TCP read, in ms */
+
+// A link to the controller. serial.c does the framing and flow control on top,
+// the same way whichever transport carries the bytes.
+typedef struct
+{
+    const char *name;
+    int (*open)(const char *target);                     // Device, host:port or file, NULL for the default. 0 on success
+    int (*read)(unsigned char *buf, int size);           // Bytes read, 0 if none came in time, -1 once the link is gone
+    int (*write)(const unsigned char *data, int length); // Bytes accepted, 0 if the link is busy, -1 on failure
+    void (*close)(void);
+    int acknowledges; // 1 if nothing answers on the other end, serial.c then acknowledges every line itself
+    int waits;        // 1 if a read waits a moment for the first byte instead of returning at once
+} Transport;
+
+extern const Transport serial_transport;  // rs232.c on cport_nr
+extern const Transport tcp_transport;     // GRBL over a TCP bridge
+extern const Transport file_transport;    // Commands written to a file
+extern const Transport null_transport;    // Commands discarded, for generation benchmarks
+extern const Transport console_transport; // Commands printed to stdout
+
+const Transport *FindTransport(const char *name); // NULL if there is no such transport
+
+typedef struct RS232_Port RS232_Port;
+RS232_Port *SerialPort(void); // Port of the serial transport, NULL while it is closed
+
+#endif // TRANSPORT_H_INCLUDED